@@ -0,0 +1,216 @@
+// Timings of formula parsing and evaluation, solver and trajectory storage,
+// printed as JSON to compare runs:
+//   benchmarks [--min-time seconds] [name filter]
+// Every case is repeated until it has run for min-time, rates are per item
+// (formula, evaluation, step or point) of the fastest repetition.
+#include <formula_processor.h>
+#include <lod_pyramid.h>
+#include <sde.h>
+#include <solver.h>
+#include <trajectory.h>
+#include <format>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "measure.h"
+
+using namespace std;
+using namespace bench;
+
+namespace {
+
+// x1 + 2*x2 - 3*x1 ... with given number of terms
+string linear_formula(int terms)
+{
+	string result = "x1";
+	for (auto i = 1; i < terms; i++)
+		result += format(" {} {}*x{}", "+-"[i % 2], i % 7 + 1, i % 2 + 1);
+	return result;
+}
+
+// ((x1 + 1) * 2 + 1) * 2 ..., depth levels of brackets
+string nested_formula(int depth)
+{
+	string result = "x1";
+	for (auto i = 0; i < depth; i++)
+		result = format("({} + {}) * 0.5", result, i);
+	return result;
+}
+
+void parsing()
+{
+	for (auto terms : {10, 100, 1000}) {
+		auto formula = linear_formula(terms);
+		measure("parse/linear", format("\"terms\": {}", terms), [&formula]() {
+			constexpr auto n = 20;
+			for (auto i = 0; i < n; i++)
+				checksum = checksum + FormulaProcessor(formula)({1, 2});
+			return n;
+		});
+	}
+	for (auto depth : {10, 50}) {
+		auto formula = nested_formula(depth);
+		measure("parse/nested", format("\"depth\": {}", depth), [&formula]() {
+			constexpr auto n = 20;
+			for (auto i = 0; i < n; i++)
+				checksum = checksum + FormulaProcessor(formula)({1});
+			return n;
+		});
+	}
+}
+
+size_t evaluate(VectorProcessor &vp, vector<double> x)
+{
+	constexpr auto n = 100'000;
+	for (auto i = 0; i < n; i++) {
+		x[0] += 1e-6;
+		checksum = checksum + vp(x)[0];
+	}
+	return n;
+}
+
+void evaluation()
+{
+	VectorProcessor lorenz;
+	lorenz[1] = "10 * (x2 - x1)";
+	lorenz[2] = "x1 * (28 - x3) - x2";
+	lorenz[3] = "x1 * x2 - 8 / 3 * x3";
+	measure("eval/lorenz", "\"dimension\": 3",
+	        [&lorenz]() { return evaluate(lorenz, {1, 1, 1}); });
+
+	for (auto terms : {10, 100}) {
+		VectorProcessor vp;
+		vp[1] = linear_formula(terms);
+		vp[2] = "x1";
+		measure("eval/linear", format("\"terms\": {}", terms),
+		        [&vp]() { return evaluate(vp, {1, 2}); });
+	}
+
+	// every aux variable refers to the previous one
+	for (auto length : {5, 50}) {
+		VectorProcessor vp;
+		vp["a0"] = "x1 + 1";
+		for (auto i = 1; i < length; i++)
+			vp[format("a{}", i)] = format("a{} * 0.5 + x1", i - 1);
+		vp[1] = format("a{}", length - 1);
+		measure("eval/aux_chain", format("\"length\": {}", length),
+		        [&vp]() { return evaluate(vp, {1}); });
+	}
+
+	// both branches are parsed, one of them is taken
+	VectorProcessor tern;
+	tern[1] = "(x1 > x2) ? ((x1 > 0) ? x1 * x2 : x1 - x2) : "
+	          "((x2 > 0) ? x2 / 3 : -x2)";
+	tern[2] = "(x1 < 0) || (x2 > 1) ? 1 : -1";
+	measure("eval/ternary", "\"dimension\": 2",
+	        [&tern]() { return evaluate(tern, {0.5, -1}); });
+}
+
+void solving()
+{
+	// damped chain of oscillators, every equation touches two components
+	for (auto dimension : {2, 8, 32}) {
+		VectorProcessor vp;
+		for (auto i = 1; i <= dimension; i++)
+			vp[i] = format("x{} - 0.1 * x{}", i % dimension + 1, i);
+		vector<double> init(dimension, 1.);
+		measure("solve/euler", format("\"dimension\": {}", dimension),
+		        [&vp, &init]() {
+			        constexpr auto steps = 20'000;
+			        EulerSolver solver(1e-3, steps, init, vp);
+			        solver.solve([](double, const vector<double> &x) {
+				        checksum = checksum + x[0];
+			        });
+			        return steps;
+		        });
+	}
+
+	// Ornstein-Uhlenbeck ensemble, items are steps of all paths
+	VectorProcessor ou;
+	ou[1] = "-x1";
+	for (auto scheme : {SdeScheme::EulerMaruyama, SdeScheme::Milstein}) {
+		SdeParams params{.step = 1e-3, .steps = 1000, .paths = 2048,
+		                 .scheme = scheme};
+		auto name = (scheme == SdeScheme::Milstein) ? "milstein" : "euler";
+		measure("solve/sde", format("\"scheme\": \"{}\"", name),
+		        [&ou, &params]() {
+			        auto stats = sde_ensemble(ou, {"1"}, {1.}, params);
+			        checksum = checksum + stats.moments.back()[0].mean;
+			        return size_t(params.steps) * params.paths;
+		        });
+	}
+}
+
+void conversion()
+{
+	// Lorenz attractor, integrated once for all cases
+	constexpr auto points = 1'000'000;
+	Trajectory trajectory;
+	trajectory.time.reserve(points);
+	trajectory.states.reserve(points);
+	vector<double> x{1, 1, 1};
+	for (auto i = 0; i < points; i++) {
+		trajectory(i * 1e-3, x);
+		auto dx = vector<double>{10 * (x[1] - x[0]), x[0] * (28 - x[2]) - x[1],
+		                         x[0] * x[1] - 8. / 3 * x[2]};
+		for (auto j = 0; j < 3; j++)
+			x[j] += dx[j] * 1e-3;
+	}
+
+	auto storages = {pair{"double", StorageMode::Double},
+	                 {"float", StorageMode::Float},
+	                 {"compressed", StorageMode::Compressed}};
+	for (auto [name, mode] : storages) {
+		auto params = format("\"storage\": \"{}\", \"points\": {}", name, points);
+		auto store = [&trajectory, mode]() {
+			auto result = make_storage(mode);
+			for (auto i = 0uz; i < trajectory.size(); i++)
+				(*result)(trajectory.time[i], trajectory.states[i]);
+			return result;
+		};
+		measure("series/store", params, [&]() {
+			checksum = checksum + store()->size();
+			return trajectory.size();
+		});
+		auto storage = store();
+		measure("series/pyramid", params, [&storage]() {
+			LodPyramid pyramid(*storage, 0, 1);
+			checksum = checksum + pyramid.bounds().x_max;
+			return storage->size();
+		});
+
+		// whole attractor at 1000 pixels, like a fitted chart
+		LodPyramid pyramid(*storage, 0, 1);
+		auto view = pyramid.bounds();
+		auto x_res = (view.x_max - view.x_min) / 1000;
+		auto y_res = (view.y_max - view.y_min) / 1000;
+		measure("series/project", params, [&]() {
+			vector<double> xs(LodPyramid::leaf_size + 1);
+			vector<double> ys(LodPyramid::leaf_size + 1);
+			auto leaf = [&](size_t first, size_t last) {
+				storage->read(0, first, last - first + 1, xs.data());
+				storage->read(1, first, last - first + 1, ys.data());
+				checksum = checksum + xs[0] + ys[0];
+			};
+			auto coarse = [](size_t, size_t, const LodBox &box) {
+				checksum = checksum + box.x_min;
+			};
+			pyramid.query(view, x_res, y_res, leaf, coarse, [](size_t, size_t) {});
+			return storage->size();
+		});
+	}
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+	parse_args(argc, argv);
+	begin_results();
+	parsing();
+	evaluation();
+	solving();
+	conversion();
+	end_results();
+}
@@ -0,0 +1,139 @@
+// Timings of chart drawing, printed like the ones of benchmarks:
+//   gui_benchmarks [--min-time seconds] [name filter]
+// Charts are drawn on the offscreen platform unless QT_QPA_PLATFORM is set.
+// Frame rates are per point of the series, a frame takes points times
+// ns_per_item. Startup and redraw cases are per window or project.
+#include <QApplication>
+#include <QChartView>
+#include <QImage>
+#include <QPainter>
+#include <QSplineSeries>
+#include <QTemporaryDir>
+#include <format>
+#include <fstream>
+#include <klfbackend.h>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <vector>
+#include "measure.h"
+#include "picture_panel.h"
+#include "polyline_series.h"
+#include "widgets.h"
+
+using namespace std;
+using namespace QtCharts;
+using namespace bench;
+
+namespace {
+
+constexpr size_t frame_points = 10'000'000;
+constexpr QSize frame_size{1000, 800};
+
+// Lorenz attractor, a long trajectory which fills the chart
+shared_ptr<TrajectoryStorage> attractor(size_t points)
+{
+	shared_ptr<TrajectoryStorage> storage = make_storage(StorageMode::Double);
+	vector<double> x{1, 1, 1};
+	for (auto i = 0uz; i < points; i++) {
+		(*storage)(i * 1e-4, x);
+		auto dx = vector<double>{10 * (x[1] - x[0]), x[0] * (28 - x[2]) - x[1],
+		                         x[0] * x[1] - 8. / 3 * x[2]};
+		for (auto j = 0; j < 3; j++)
+			x[j] += dx[j] * 1e-4;
+	}
+	return storage;
+}
+
+// Renders the chart of series offscreen, every repetition paints it again
+void frame(const string &name, QAbstractSeries *series, size_t points)
+{
+	QChartView view;
+	view.resize(frame_size);
+	populate_chart(view.chart(), {series});
+	view.show();
+	QApplication::processEvents();
+	QImage image(frame_size, QImage::Format_ARGB32_Premultiplied);
+	measure(name, format("\"points\": {}", points), [&]() {
+		QPainter painter(&image);
+		view.render(&painter);
+		return points;
+	});
+}
+
+void frames()
+{
+	if (!selected("frame/polyline") && !selected("frame/spline"))
+		return;
+	auto storage = attractor(frame_points);
+	frame("frame/polyline", new PolylineSeries(storage, 0, 1), frame_points);
+
+	// how trajectories were drawn before, Qt keeps its own copy of points
+	if (!selected("frame/spline"))
+		return;
+	QVector<QPointF> points;
+	points.reserve(frame_points);
+	storage->for_each_point(
+	  0, 1, 0, [&points](double x, double y) { points.append({x, y}); });
+	auto spline = new QSplineSeries;
+	spline->replace(points);
+	frame("frame/spline", spline, frame_points);
+}
+
+void startup()
+{
+	// until the window is shown, TeX tools aren't probed here any more
+	measure("startup/window", "\"charts\": 1", []() {
+		MainWindow window(nullptr);
+		window.show();
+		QApplication::processEvents();
+		return 1uz;
+	});
+	// what every PictureTab constructor took before, now once per process
+	measure("startup/detect_settings", "\"tools\": \"latex, dvips, gs\"", []() {
+		KLFBackend::klfSettings settings;
+		KLFBackend::detectSettings(&settings);
+		return 1uz;
+	});
+}
+
+void redraw()
+{
+	if (!selected("redraw/project"))
+		return;
+	// project opened again and again, its chart tabs are reused
+	constexpr auto charts = 3;
+	nlohmann::json chart = {{"equations", nlohmann::json::array({"x2", "-x1"})},
+	                        {"inits", {1, 0}},
+	                        {"step", 1e-3},
+	                        {"steps_num", 100'000},
+	                        {"color", "#ff0000"}};
+	nlohmann::json project;
+	for (auto i = 0; i < charts; i++)
+		project["charts"].push_back(chart);
+	QTemporaryDir dir;
+	auto path = dir.filePath("project.json");
+	std::ofstream(path.toStdString()) << project;
+
+	MainWindow window(nullptr);
+	window.show();
+	measure("redraw/project", format("\"charts\": {}", charts), [&]() {
+		window.picture_panel->open_project(path);
+		QApplication::processEvents();
+		return 1uz;
+	});
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+	if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	QApplication app(argc, argv);
+	parse_args(argc, argv);
+	begin_results();
+	startup();
+	redraw();
+	frames();
+	end_results();
+}
@@ -0,0 +1,67 @@
+#pragma once
+// Harness of the benchmark programs. Results are printed as JSON objects of
+// one "benchmarks" array, so runs can be compared by a script.
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <print>
+#include <string>
+
+namespace bench {
+
+inline double min_time = 0.5;
+inline std::string filter;
+inline bool first_result = true;
+// Results are summed here, so the compiler can't drop the work
+inline volatile double checksum;
+
+inline bool selected(const std::string &name)
+{
+	return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+// Runs work, which returns the number of items it has processed, and prints
+// a JSON object with the rate. Params are already formatted JSON members.
+inline void measure(const std::string &name, const std::string &params,
+                    const std::function<size_t()> &work)
+{
+	if (!selected(name))
+		return;
+	using clock = std::chrono::steady_clock;
+	auto best = std::numeric_limits<double>::infinity();
+	auto items = 0uz, repetitions = 0uz;
+	auto total = 0.;
+	while (total < min_time || repetitions < 3) {
+		auto start = clock::now();
+		items = work();
+		std::chrono::duration<double> elapsed = clock::now() - start;
+		best = std::min(best, elapsed.count() / items);
+		total += elapsed.count();
+		repetitions++;
+	}
+	std::print("{}    {{\"name\": \"{}\", {}, \"repetitions\": {}, "
+	           "\"items\": {}, \"ns_per_item\": {:.3f}, "
+	           "\"items_per_second\": {:.0f}}}",
+	           first_result ? "" : ",\n", name, params, repetitions, items,
+	           best * 1e9, 1 / best);
+	first_result = false;
+}
+
+// [--min-time seconds] [name filter]
+inline void parse_args(int argc, char *argv[])
+{
+	for (auto i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--min-time" && i + 1 < argc)
+			min_time = std::atof(argv[++i]);
+		else
+			filter = arg;
+	}
+}
+
+inline void begin_results() { std::print("{{\n  \"benchmarks\": [\n"); }
+inline void end_results() { std::println("\n  ]\n}}"); }
+
+} // namespace bench
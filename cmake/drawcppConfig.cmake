@@ -1,5 +1,6 @@
 include(CMakeFindDependencyMacro)
-find_dependency(Qt5 REQUIRED COMPONENTS Widgets Charts)
+find_dependency(Qt5 REQUIRED COMPONENTS Widgets Charts Svg)
 find_dependency(nlohmann_json REQUIRED)
+find_dependency(Threads REQUIRED)
 
 include("${CMAKE_INSTALL_PREFIX}/lib/cmake/drawcpp.cmake")
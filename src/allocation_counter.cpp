@@ -0,0 +1,21 @@
+// Replacement of operator new counting allocations for Trace. Linked into
+// the programs only, the drawing library leaves allocation alone.
+#include <cstdlib>
+#include <new>
+#include "trace.h"
+
+using namespace std;
+
+// Counting costs an increment of a thread local variable
+void *operator new(size_t size)
+{
+	trace_detail::allocations++;
+	for (;;) {
+		if (auto p = malloc(size ? size : 1))
+			return p;
+		auto handler = get_new_handler();
+		if (!handler)
+			throw bad_alloc();
+		handler();
+	}
+}
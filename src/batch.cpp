@@ -0,0 +1,304 @@
+// Renders project files to images without GUI:
+//   drawcpp_batch [-o dir] [-f png|pdf|svg] [-s WxH] [-j jobs] [-d csv|bin]
+//                 [-m MB] project.json...
+// Projects are solved on worker threads, charts are drawn on the main thread
+// because Qt graphics classes aren't thread safe.
+#include <QApplication>
+#include <QChartView>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFileInfo>
+#include <QPainter>
+#include <QTemporaryDir>
+#include <QValueAxis>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include "chart_export.h"
+#include "chart_spec.h"
+#include "latex_cache.h"
+#include "picture_panel.h"
+#include "density_series.h"
+
+using namespace std;
+using namespace QtCharts;
+
+namespace {
+
+struct Options {
+	QString output{"."};
+	QString format{"png"};
+	QSize size{800, 600};
+	unsigned jobs{thread::hardware_concurrency()};
+	QString data; // format of trajectory files, none if empty
+	size_t budget{default_memory_budget}; // per chart
+};
+
+struct Label {
+	QPointF coords;
+	QImage image;
+};
+
+// Everything about a project that can be computed off the main thread
+struct SolvedProject {
+	struct Chart {
+		ChartSpec spec;
+		shared_ptr<const TrajectoryStorage> storage;
+		vector<BifurcationPoint> points; // of sweep
+	};
+
+	QString path;
+	QString error;
+	vector<Chart> charts;
+	map<QString, vector<Label>> labels; // by chart label
+};
+
+SolvedProject solve_project(const QString &path, const Options &options,
+                            const KLFBackend::klfSettings *settings,
+                            unsigned sweep_threads)
+{
+	SolvedProject result{.path = path};
+	try {
+		ifstream ifs(path.toStdString());
+		if (!ifs)
+			throw runtime_error("can't open file");
+		nlohmann::json info;
+		ifs >> info;
+
+		auto name = QFileInfo(path).completeBaseName();
+		for (auto &j : info.at("charts")) {
+			auto &chart = result.charts.emplace_back();
+			chart.spec = j.get<ChartSpec>();
+			// data files of the project are replaced by the ones in output
+			chart.spec.data_file.clear();
+			if (options.data.size()) {
+				auto file = QString("%1_%2.%3")
+				              .arg(name)
+				              .arg(result.charts.size())
+				              .arg(options.data);
+				chart.spec.data_file =
+				  QDir(options.output).filePath(file).toStdString();
+			}
+			if (chart.spec.sweep)
+				chart.points = chart.spec.bifurcation(sweep_threads);
+			else
+				chart.storage = chart.spec.solve(options.budget);
+		}
+
+		if (!settings || !info.contains("latex"))
+			return result;
+		QTemporaryDir tmp;
+		auto worker_settings = *settings;
+		if (tmp.isValid())
+			worker_settings.tempdir = tmp.path();
+		for (auto &[label, texts] : info["latex"].items()) {
+			for (auto &j : texts) {
+				Text text(j);
+				auto input = latex_input();
+				input.latex = text.text;
+				input.fontsize = text.font;
+				result.labels[QString::fromStdString(label)].push_back(
+				  {text.coords, render_latex(input, worker_settings)});
+			}
+		}
+	}
+	catch (exception &e) {
+		result.error = e.what();
+	}
+	return result;
+}
+
+// Series grouped by label like tabs of PicturePanel
+SeriesInfo make_series(const SolvedProject &project)
+{
+	SeriesInfo result;
+	for (auto &[spec, storage, points] : project.charts) {
+		QColor color(QString::fromStdString(spec.color));
+		if (spec.sweep) {
+			QVector<QPointF> cloud;
+			cloud.reserve(points.size());
+			for (auto &p : points)
+				cloud.append({p.parameter, p.value});
+			auto series = scatter_series(color);
+			series->replace(cloud);
+			auto label = QString::fromStdString(spec.sweep->parameter);
+			result[label + "/" + comp_name(spec.y_comp)].append(series);
+			continue;
+		}
+
+		QXYSeries *series;
+		if (spec.output == OutputMode::Trajectory) {
+			if (spec.density)
+				series = new DensitySeries(storage, spec.x_comp, spec.y_comp);
+			else
+				series = new PolylineSeries(storage, spec.x_comp, spec.y_comp);
+			auto pen = series->pen();
+			pen.setWidth(2);
+			pen.setColor(color);
+			series->setPen(pen);
+		}
+		else {
+			QVector<QPointF> hits;
+			storage->for_each_point(
+			  spec.x_comp, spec.y_comp, 0,
+			  [&hits](double x, double y) { hits.append({x, y}); });
+			series = scatter_series(color);
+			series->replace(hits);
+		}
+		result[comp_name(spec.x_comp) + "/" + comp_name(spec.y_comp)].append(
+		  series);
+	}
+	return result;
+}
+
+void render_project(const SolvedProject &project, const Options &options)
+{
+	auto charts = make_series(project);
+	auto name = QFileInfo(project.path).completeBaseName();
+	for (auto &[label, series] : charts) {
+		QChartView view;
+		view.setRenderHint(QPainter::Antialiasing);
+		view.setFrameShape(QFrame::NoFrame); // viewport gets the whole size
+		view.resize(options.size);
+		auto chart = view.chart();
+		chart->legend()->setVisible(true);
+		populate_chart(chart, series);
+		for (auto axis : chart->axes())
+			static_cast<QValueAxis *>(axis)->setTickCount(2);
+		// offscreen platform lays the chart out as a shown window
+		view.show();
+		QApplication::processEvents();
+
+		auto file = name;
+		if (charts.size() > 1)
+			file += "_" + QString(label).replace('/', '-');
+		file = QDir(options.output).filePath(file + "." + options.format);
+
+		auto it = project.labels.find(label);
+		auto labels = (it != project.labels.end()) ? it->second :
+		                                             vector<Label>{};
+		auto decorate = [&view, &labels](QPainter &painter) {
+			for (auto &l : labels)
+				painter.drawPixmap(view.chart()->mapToPosition(l.coords),
+				                   latex_pixmap(l.image));
+		};
+		if (!export_chart(view, file, decorate))
+			cerr << file.toStdString() << ": can't write file\n";
+	}
+}
+
+Options parse_options(QCommandLineParser &parser)
+{
+	Options options;
+	if (parser.isSet("output"))
+		options.output = parser.value("output");
+	if (parser.isSet("format"))
+		options.format = parser.value("format").toLower();
+	if (options.format != "png" && options.format != "pdf" &&
+	    options.format != "svg")
+		throw runtime_error("format must be png, pdf or svg");
+	if (parser.isSet("size")) {
+		auto wh = parser.value("size").split('x');
+		if (wh.size() != 2 || wh[0].toInt() <= 0 || wh[1].toInt() <= 0)
+			throw runtime_error("size must be WIDTHxHEIGHT");
+		options.size = {wh[0].toInt(), wh[1].toInt()};
+	}
+	if (parser.isSet("data"))
+		options.data = parser.value("data").toLower();
+	if (options.data.size() && options.data != "csv" && options.data != "bin")
+		throw runtime_error("data format must be csv or bin");
+	if (parser.isSet("memory")) {
+		auto mb = parser.value("memory").toULongLong();
+		if (!mb)
+			throw runtime_error("memory budget must be a positive number of MB");
+		options.budget = mb << 20;
+	}
+	if (parser.isSet("jobs"))
+		options.jobs = parser.value("jobs").toUInt();
+	options.jobs = max(options.jobs, 1u);
+	return options;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+	if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	QApplication app(argc, argv);
+	app.setApplicationName("drawcpp"); // shares latex cache with GUI
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Renders drawcpp projects to images");
+	parser.addHelpOption();
+	parser.addOptions({
+	  {{"o", "output"}, "Output directory.", "dir"},
+	  {{"f", "format"}, "png, pdf or svg.", "format"},
+	  {{"s", "size"}, "Picture size, 800x600 by default.", "WxH"},
+	  {{"j", "jobs"}, "Projects solved in parallel.", "n"},
+	  {{"d", "data"}, "Also write trajectories as csv or bin.", "format"},
+	  {{"m", "memory"}, "Memory budget per chart, 2048 by default.", "MB"},
+	});
+	parser.addPositionalArgument("projects", "Project files.", "project...");
+	parser.process(app);
+
+	Options options;
+	try {
+		options = parse_options(parser);
+	}
+	catch (exception &e) {
+		cerr << e.what() << "\n";
+		return 2;
+	}
+	auto projects = parser.positionalArguments();
+	if (projects.empty())
+		parser.showHelp(2);
+	QDir().mkpath(options.output);
+
+	auto latex = latex_settings();
+	if (!latex)
+		cerr << "latex tools not found, labels are skipped\n";
+
+	// workers stay at most jobs projects ahead of rendering
+	mutex m;
+	condition_variable cv;
+	deque<SolvedProject> ready;
+	atomic<int> next{0};
+	// project level parallelism is enough unless there are few projects
+	auto sweep_threads = (projects.size() > 1) ? 1 : 0;
+	vector<jthread> workers;
+	for (auto i = 0u; i < min<unsigned>(options.jobs, projects.size()); i++)
+		workers.emplace_back([&]() {
+			for (int idx; (idx = next++) < projects.size();) {
+				auto solved =
+				  solve_project(projects[idx], options, latex, sweep_threads);
+				unique_lock lock(m);
+				cv.wait(lock, [&]() { return ready.size() < options.jobs; });
+				ready.push_back(std::move(solved));
+				cv.notify_all();
+			}
+		});
+
+	auto failed = 0;
+	for (auto done = 0; done < projects.size(); done++) {
+		unique_lock lock(m);
+		cv.wait(lock, [&]() { return !ready.empty(); });
+		auto project = std::move(ready.front());
+		ready.pop_front();
+		cv.notify_all();
+		lock.unlock();
+
+		if (project.error.size()) {
+			cerr << project.path.toStdString() << ": "
+			     << project.error.toStdString() << "\n";
+			failed++;
+			continue;
+		}
+		render_project(project, options);
+	}
+	return failed ? 1 : 0;
+}
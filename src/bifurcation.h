@@ -0,0 +1,175 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+#include "formula_processor.h"
+#include "section.h"
+
+// Which values of the component are collected after the transient
+enum class BifurcationCollect {
+	Final,  // evenly spaced samples of the observation window
+	Maxima, // local maxima
+	Section // values at crossings of section surface
+};
+
+struct BifurcationParams {
+	std::string parameter; // swept parameter or aux variable
+	double from{};
+	double to{};
+	int count{};
+	double step{};
+	int transient_steps{}; // integrated but discarded
+	int steps{};           // observation window
+	size_t component{};
+	BifurcationCollect collect{BifurcationCollect::Final};
+	std::string section{}; // surface for BifurcationCollect::Section
+	size_t max_points{200}; // per parameter value
+	unsigned threads{};     // 0 means all hardware threads
+};
+
+struct BifurcationPoint {
+	double parameter;
+	double value;
+};
+
+namespace bifurcation_detail {
+
+// Collects values of one component after the transient is over
+class Collector {
+	const BifurcationParams &params;
+	std::vector<double> &values;
+	double transient_time;
+	int stride;
+	int index{0};
+	double prev{};
+	double prev_prev{};
+
+public:
+	Collector(const BifurcationParams &p, std::vector<double> &v)
+	  : params(p), values(v), transient_time(p.transient_steps * p.step),
+	    stride(std::max<int>(1, p.steps / std::max<size_t>(1, p.max_points)))
+	{
+	}
+
+	void operator()(double t, const std::vector<double> &x)
+	{
+		if (t < transient_time || values.size() >= params.max_points)
+			return;
+		auto value = x[params.component];
+		switch (params.collect) {
+		case BifurcationCollect::Final:
+			if (index % stride == 0)
+				values.push_back(value);
+			break;
+		case BifurcationCollect::Maxima:
+			if (index >= 2 && prev_prev < prev && prev >= value)
+				values.push_back(prev);
+			break;
+		case BifurcationCollect::Section:
+			values.push_back(value);
+			break;
+		}
+		prev_prev = prev;
+		prev = value;
+		index++;
+	}
+};
+
+// Parameter of vp in the slot takes the value
+inline std::vector<double> sweep_value(VectorProcessor vp, size_t slot,
+                                       const std::vector<double> &init,
+                                       const BifurcationParams &params,
+                                       double parameter)
+{
+	vp.set_parameter(slot, parameter);
+	std::vector<double> values;
+	Collector collector(params, values);
+	EulerSolver solver(params.step, params.transient_steps + params.steps, init,
+	                   vp);
+	if (params.collect == BifurcationCollect::Section) {
+		FormulaProcessor surface(params.section, &vp);
+		auto h = [&vp, &surface](const std::vector<double> &x) {
+			return vp(surface, x);
+		};
+		PoincareSection crossings(h, collector);
+		// solver evaluates its own copy of vp, this one sees t only if the
+		// time of the sample is set here
+		auto timed = [&vp, &crossings](double t, const std::vector<double> &x) {
+			vp.set_time(t);
+			crossings(t, x);
+		};
+		solver.solve(timed);
+	}
+	else {
+		solver.solve(collector);
+	}
+	return values;
+}
+
+} // namespace bifurcation_detail
+
+// Integrates the system for every value of the swept parameter in parallel.
+// Points are ordered by parameter value whatever the number of threads is.
+inline std::vector<BifurcationPoint>
+bifurcation_diagram(const VectorProcessor &vp, const std::vector<double> &init,
+                    const BifurcationParams &params)
+{
+	if (params.count < 1)
+		throw std::invalid_argument("Bifurcation needs at least one value");
+	if (params.component >= init.size())
+		throw std::invalid_argument("Bifurcation component out of range");
+	if (!vp.contains(params.parameter) && !vp.is_parameter(params.parameter))
+		throw std::invalid_argument("Unknown parameter " + params.parameter);
+
+	// swept aux variable becomes a parameter, so values aren't parsed
+	auto swept = vp;
+	auto slot = swept.is_parameter(params.parameter) ?
+	              swept.declare_parameter(params.parameter,
+	                                      swept.parameter(params.parameter)) :
+	              swept.aux_to_parameter(params.parameter);
+
+	auto param_value = [&params](int i) {
+		if (params.count == 1)
+			return params.from;
+		return params.from + (params.to - params.from) * i / (params.count - 1);
+	};
+
+	std::vector<std::vector<double>> values(params.count);
+	std::atomic<int> next{0};
+	std::exception_ptr error;
+	std::atomic_flag error_set;
+	auto work = [&]() {
+		for (auto i = next++; i < params.count; i = next++) {
+			try {
+				values[i] = bifurcation_detail::sweep_value(swept, slot, init, params,
+				                                            param_value(i));
+			}
+			catch (...) {
+				if (!error_set.test_and_set())
+					error = std::current_exception();
+				next = params.count;
+			}
+		}
+	};
+
+	auto threads_num = params.threads;
+	if (!threads_num)
+		threads_num = std::max(1u, std::thread::hardware_concurrency());
+	{
+		std::vector<std::jthread> workers;
+		for (auto i = 1u; i < std::min<unsigned>(threads_num, params.count); i++)
+			workers.emplace_back(work);
+		work();
+	}
+	if (error)
+		std::rethrow_exception(error);
+
+	std::vector<BifurcationPoint> result;
+	for (auto i = 0; i < params.count; i++)
+		for (auto value : values[i])
+			result.push_back({param_value(i), value});
+	return result;
+}
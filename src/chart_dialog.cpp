@@ -1,16 +1,37 @@
+#include <QCheckBox>
 #include <QColorDialog>
+#include <QFileDialog>
 #include <QDialogButtonBox>
 #include <QLabel>
 #include <QMessageBox>
 #include <QApplication>
-#include <QSplineSeries>
+#include <QSettings>
 #include "chart_dialog.h"
-#include "solver.h"
+#include "density_series.h"
+#include "solve_job.h"
+#include "trace.h"
 
 using namespace std;
 using namespace QtCharts;
 using namespace nlohmann;
 
+namespace {
+
+// Preview solves follow a slider: trajectories are integrated with a larger
+// step to about this many points, sweeps take fewer parameter values
+constexpr int preview_points = 20'000;
+
+} // namespace
+
+QString memory_text(size_t bytes)
+{
+	if (bytes >= size_t(1) << 30)
+		return QString::number(bytes / double(1 << 30), 'f', 1) + " GB";
+	if (bytes >= size_t(1) << 20)
+		return QString::number(bytes / double(1 << 20), 'f', 1) + " MB";
+	return QString::number(bytes / double(1 << 10), 'f', 1) + " KB";
+}
+
 AuxVarItem::AuxVarItem(QVBoxLayout *o, const QString &n, const QString &f)
 {
 	auto layout = new QHBoxLayout(this);
@@ -27,10 +48,10 @@ AuxVarItem::AuxVarItem(QVBoxLayout *o, const QString &n, const QString &f)
 	});
 }
 
-AuxVarEdit::AuxVarEdit()
+AuxVarEdit::AuxVarEdit(const QString &add_text)
 {
 	layout = new QVBoxLayout(this);
-	auto add_button = new QPushButton("Add auxilliary");
+	auto add_button = new QPushButton(add_text);
 	layout->addWidget(add_button);
 
 	connect(add_button, &QPushButton::released, this,
@@ -42,6 +63,15 @@ void AuxVarEdit::add(QString name, QString formula)
 	layout->addWidget(new AuxVarItem(layout, name, formula));
 }
 
+void AuxVarEdit::set(const QString &name, const QString &formula)
+{
+	for (auto i = 1; i < layout->count(); i++) {
+		auto variable = dynamic_cast<AuxVarItem *>(layout->itemAt(i)->widget());
+		if (variable->name() == name)
+			variable->set_formula(formula);
+	}
+}
+
 map<QString, QString> AuxVarEdit::get() const
 {
 	map<QString, QString> result;
@@ -180,6 +210,7 @@ void ChartDialogTab::comp_added(const QString &num)
 	comp_choice->comp_added(num);
 	init_button->setStyleSheet("QPushButton {color: red;}");
 	init_value.clear();
+	update_estimate();
 }
 
 void ChartDialogTab::comp_removed()
@@ -190,13 +221,88 @@ void ChartDialogTab::comp_removed()
 	init_edit->layout->removeRow(init_edit->layout->rowCount() - 2);
 	init_button->setStyleSheet("QPushButton {color: red;}");
 	init_value.clear();
+	update_estimate();
+}
+
+SweepEdit::SweepEdit(QWidget *parent)
+  : QGroupBox("Bifurcation sweep", parent), param_edit(new QLineEdit(this)),
+    from_edit(new QDoubleSpinBox(this)), to_edit(new QDoubleSpinBox(this)),
+    count_edit(new QSpinBox(this)), transient_edit(new QSpinBox(this)),
+    collect_edit(new QComboBox(this))
+{
+	setCheckable(true);
+	setChecked(false);
+	param_edit->setPlaceholderText("parameter");
+	for (auto edit : {from_edit, to_edit}) {
+		edit->setRange(-1e9, 1e9);
+		edit->setDecimals(5);
+	}
+	to_edit->setValue(1);
+	count_edit->setRange(1, 1e6);
+	count_edit->setValue(500);
+	transient_edit->setRange(0, 1e9);
+	transient_edit->setSingleStep(1000);
+	transient_edit->setValue(1e4);
+	collect_edit->addItems({"Final values", "Local maxima", "Section hits"});
+
+	auto form = new QFormLayout(this);
+	auto range_layout = new QHBoxLayout();
+	range_layout->addWidget(param_edit);
+	range_layout->addWidget(new QLabel("from"));
+	range_layout->addWidget(from_edit);
+	range_layout->addWidget(new QLabel("to"));
+	range_layout->addWidget(to_edit);
+	form->addRow("Parameter:", range_layout);
+	auto count_layout = new QHBoxLayout();
+	count_layout->addWidget(new QLabel("Values:"));
+	count_layout->addWidget(count_edit);
+	count_layout->addWidget(new QLabel("Transient steps:"));
+	count_layout->addWidget(transient_edit);
+	form->addRow(count_layout);
+	form->addRow("Collect:", collect_edit);
+}
+
+BifurcationParams SweepEdit::get() const
+{
+	return {.parameter = param_edit->text().toStdString(),
+	        .from = from_edit->value(),
+	        .to = to_edit->value(),
+	        .count = count_edit->value(),
+	        .transient_steps = transient_edit->value(),
+	        .collect = BifurcationCollect(collect_edit->currentIndex())};
+}
+
+SweepEdit::operator json() const
+{
+	json result;
+	result["enabled"] = isChecked();
+	result["parameter"] = param_edit->text().toStdString();
+	result["from"] = from_edit->value();
+	result["to"] = to_edit->value();
+	result["count"] = count_edit->value();
+	result["transient"] = transient_edit->value();
+	result["collect"] = collect_edit->currentIndex();
+	return result;
+}
+
+void SweepEdit::from_json(const json &j)
+{
+	setChecked(j["enabled"]);
+	param_edit->setText(QString::fromStdString(j["parameter"]));
+	from_edit->setValue(j["from"]);
+	to_edit->setValue(j["to"]);
+	count_edit->setValue(j["count"]);
+	transient_edit->setValue(j["transient"]);
+	collect_edit->setCurrentIndex(j["collect"]);
 }
 
 ChartDialogTab::ChartDialogTab(QWidget *parent): QWidget(parent)
 {
 	auto form = new QFormLayout(this);
+	param_edit = new AuxVarEdit("Add parameter");
 	aux_edit = new AuxVarEdit;
 	equations_edit = new EquationsEdit(this);
+	form->addRow(param_edit);
 	form->addRow(aux_edit);
 	form->addRow(equations_edit);
 	init_edit = new InitEdit(this);
@@ -227,11 +333,56 @@ ChartDialogTab::ChartDialogTab(QWidget *parent): QWidget(parent)
 	steps_layout->addWidget(steps_num_edit);
 	form->addRow(steps_layout);
 
+	output_edit = new QComboBox(this);
+	output_edit->addItems({"Trajectory", "Poincare section", "Stroboscopic"});
+	section_edit = new QLineEdit(this);
+	section_edit->setEnabled(false);
+	connect(output_edit, qOverload<int>(&QComboBox::currentIndexChanged), this,
+	        [this](int mode) {
+		        section_edit->setEnabled(mode != int(OutputMode::Trajectory));
+		        section_edit->setPlaceholderText(
+		          mode == int(OutputMode::Stroboscopic) ? "period" : "h(x) = 0");
+	        });
+	storage_edit = new QComboBox(this);
+	storage_edit->addItems({"Double", "Float32", "Compressed"});
+	auto output_layout = new QHBoxLayout();
+	output_layout->addWidget(new QLabel("Output:"));
+	output_layout->addWidget(output_edit);
+	output_layout->addWidget(section_edit);
+	output_layout->addWidget(new QLabel("Storage:"));
+	output_layout->addWidget(storage_edit);
+	density_edit = new QCheckBox("Density", this);
+	density_edit->setToolTip("Draw trajectory as density of points");
+	output_layout->addWidget(density_edit);
+	form->addRow(output_layout);
+	memory_label = new QLabel(this);
+	form->addRow(memory_label);
+
+	data_edit = new QLineEdit(this);
+	data_edit->setPlaceholderText("not saved");
+	auto browse_button = new QPushButton("Browse", this);
+	connect(browse_button, &QPushButton::released, this, [this]() {
+		auto file = QFileDialog::getSaveFileName(
+		  this, "Stream data to", "", "Binary (*.bin);;CSV (*.csv)");
+		if (file.size())
+			data_edit->setText(file);
+	});
+	auto data_layout = new QHBoxLayout();
+	data_layout->addWidget(new QLabel("Data file:"));
+	data_layout->addWidget(data_edit);
+	data_layout->addWidget(browse_button);
+	form->addRow(data_layout);
+
+	sweep_edit = new SweepEdit(this);
+	form->addRow(sweep_edit);
+
 	comp_choice = new ComponentChoice(this);
 	form->addRow("Axis:", comp_choice);
 	auto add_axis = new QPushButton("Add Axis", this);
-	connect(add_axis, &QPushButton::released,
-	        [this]() { comp_choice->add_pair(); });
+	connect(add_axis, &QPushButton::released, this, [this]() {
+		comp_choice->add_pair();
+		update_estimate();
+	});
 	form->addRow(add_axis);
 
 	QPixmap icon_map(100, 100);
@@ -245,14 +396,103 @@ ChartDialogTab::ChartDialogTab(QWidget *parent): QWidget(parent)
 	};
 	connect(color_button, &QPushButton::released, this, choose_color);
 	form->addRow(color_button);
+
+	auto estimate = [this]() { update_estimate(); };
+	connect(steps_num_edit, qOverload<int>(&QSpinBox::valueChanged), this,
+	        estimate);
+	for (auto box : {output_edit, storage_edit})
+		connect(box, qOverload<int>(&QComboBox::currentIndexChanged), this,
+		        estimate);
+	connect(data_edit, &QLineEdit::textChanged, this, estimate);
+	update_estimate();
+}
+
+size_t ChartDialogTab::keep_every() const
+{
+	if (output_edit->currentIndex() != int(OutputMode::Trajectory))
+		return 1;
+	return decimation(memory_estimate(StorageMode(storage_edit->currentIndex()),
+	                                  equations_edit->size(),
+	                                  steps_num_edit->value() + 1uz,
+	                                  comp_choice->comps_size()),
+	                  budget);
+}
+
+void ChartDialogTab::update_estimate()
+{
+	// sections keep few points
+	if (output_edit->currentIndex() != int(OutputMode::Trajectory)) {
+		memory_label->clear();
+		return;
+	}
+	auto estimate = memory_estimate(StorageMode(storage_edit->currentIndex()),
+	                                equations_edit->size(),
+	                                steps_num_edit->value() + 1uz,
+	                                comp_choice->comps_size());
+	auto text = "Memory: up to " + memory_text(estimate);
+	auto every = decimation(estimate, budget);
+	if (every > 1) {
+		text += QString(", over budget, every %1th point is drawn").arg(every);
+		if (data_edit->text().size())
+			text += ", all of them go to the data file";
+	}
+	memory_label->setText(text);
+}
+
+void ChartDialogTab::set_budget(size_t bytes)
+{
+	budget = bytes;
+	update_estimate();
+}
+
+size_t ChartDialogTab::memory() const
+{
+	auto result = solution ? solution->memory() : 0uz;
+	for (auto &[comps, pyramid] : pyramids)
+		result += pyramid->memory();
+	return result;
+}
+
+string ChartDialogTab::parse_key() const
+{
+	json tab = *this;
+	json key;
+	for (auto &[name, value] : param_edit->get())
+		key["parameters"].push_back(name.toStdString()); // values aren't parsed
+	key["aux_vars"] = tab["aux_vars"];
+	key["equations"] = tab["equations"];
+	key["output"] = output_edit->currentIndex();
+	key["sweep"] = *sweep_edit;
+	key["section"] = section_edit->text().toStdString();
+	return key.dump();
+}
+
+string ChartDialogTab::solve_key() const
+{
+	json key = *this;
+	for (auto view : {"x_comp", "y_comp", "color", "density"})
+		key.erase(view);
+	key["inits"] = init_value;
+	key["every"] = keep_every();
+	return key.dump();
 }
 
 bool ChartDialogTab::check()
 {
+	auto key = parse_key();
+	if (key == parsed_key)
+		return set_parameters();
+	parsed_key.clear();
+	ScopedTimer timer("parse");
 	vp = {};
 	auto i = 1z;
 	QString var_name;
+	auto has_section = false;
 	try {
+		for (auto &[name, value] : param_edit->get()) {
+			var_name = name;
+			vp.declare_parameter(name.toStdString());
+		}
 		for (auto &eq : equations_edit->get()) {
 			var_name = QString("%1%2").arg(default_variable).arg(i);
 			vp[i++] = eq.toStdString();
@@ -261,6 +501,17 @@ bool ChartDialogTab::check()
 			var_name = name;
 			vp[name.toStdString()] = eq.toStdString();
 		}
+		auto sweep_section =
+		  sweep_edit->isChecked() &&
+		  sweep_edit->get().collect == BifurcationCollect::Section;
+		if (output_edit->currentIndex() != int(OutputMode::Trajectory) ||
+		    sweep_section) {
+			var_name = output_edit->currentText();
+			if (section_edit->text().isEmpty())
+				throw runtime_error("Section is not set");
+			section = FormulaProcessor(section_edit->text().toStdString(), &vp);
+			has_section = true;
+		}
 	}
 	catch (exception &e) {
 		auto err_msg = QString("Wrong equation format for variable %1:\n %2")
@@ -269,57 +520,206 @@ bool ChartDialogTab::check()
 		QMessageBox::warning(this, "Error", err_msg);
 		return false;
 	}
+	// names and components are checked once everything is parsed
+	try {
+		vp.finalize();
+		if (has_section)
+			vp.resolve(section, "section");
+	}
+	catch (exception &e) {
+		QMessageBox::warning(this, "Error",
+		                     QString("Wrong equations:\n %1").arg(e.what()));
+		return false;
+	}
+
+	timer.add_items(equations_edit->size() + aux_edit->get().size());
+	parsed_key = key;
+	return set_parameters();
+}
 
+bool ChartDialogTab::set_parameters()
+{
+	for (auto &[name, text] : param_edit->get()) {
+		bool ok;
+		auto value = text.toDouble(&ok);
+		if (!ok) {
+			QMessageBox::warning(this, "Error",
+			                     "Wrong value of parameter " + name + ": " + text);
+			return false;
+		}
+		vp.set_parameter(name.toStdString(), value);
+	}
 	return true;
 }
 
-void ChartDialogTab::get(SeriesInfo &info)
+map<QString, double> ChartDialogTab::parameters() const
+{
+	map<QString, double> result;
+	for (auto &[name, value] : param_edit->get())
+		result[name] = value.toDouble();
+	return result;
+}
+
+void ChartDialogTab::set_parameter(const QString &name, double value)
+{
+	param_edit->set(name, QString::number(value, 'g', 17));
+}
+
+void ChartDialogTab::solve(int reduce)
+{
+	// worker gets its own copies, so the dialog can be edited meanwhile.
+	// Previews are within any budget and aren't written to the data file.
+	auto mode = OutputMode(output_edit->currentIndex());
+	shared_ptr<TrajectoryStorage> storage =
+	  make_storage(StorageMode(storage_edit->currentIndex()));
+	solution = storage;
+	job = new SolveJob(storage, this);
+	connect(job, &SolveJob::failed, this, [this](const QString &error) {
+		solved_key.clear(); // solved again next time
+		QMessageBox::warning(this, "Error", "Solving failed: " + error);
+	});
+	auto preview = reduce > 1;
+	job->start([vp = vp, init = init_value, step = step_edit->value() * reduce,
+	            steps_num = steps_num_edit->value() / reduce, mode,
+	            section_text = section_edit->text().toStdString(),
+	            data_file = preview ? ""s : data_edit->text().toStdString(),
+	            every = preview ? 1uz : keep_every()](
+	             SolveJob::Sink &sink, const stop_token &stop) mutable {
+		solve_output(vp, init, step, steps_num, mode, section_text, data_file,
+		             every, sink, stop);
+	});
+}
+
+void ChartDialogTab::get(SeriesInfo &info, bool preview)
 {
 	if (!init_value.size()) {
 		QMessageBox::warning(this, "Error", "Initial conditions not set");
 		return;
 	}
-	auto step = step_edit->value();
-	auto steps_num = steps_num_edit->value();
-	EulerSolver solver(step, steps_num, init_value, vp);
-	decltype(solver.solve()) solution;
-	try {
-		solution = solver.solve();
+	// sweeps are too slow for every move of a slider, previews show the
+	// last diagram until the full get after the slider stops
+	if (sweep_edit->isChecked() && preview) {
+		sweep(info, false);
+		return;
 	}
-	catch (exception &e) {
-		QMessageBox::warning(this, "Error",
-		                     "Wrong equation format: " + QString(e.what()));
+	auto reduce = preview ? max(1, steps_num_edit->value() / preview_points) : 1;
+	preview = reduce > 1; // short solves are full ones anyway
+
+	// tabs which didn't change keep their solution, a full one even for
+	// previews, so only the ones a slider moved are solved again
+	auto key = solve_key();
+	if (key != solved_key || (solved_preview && !preview)) {
+		solved_key = key;
+		solved_preview = preview;
+		delete job; // stops the solve if it is still running
+		job = nullptr;
+		solution = {};
+		pyramids.clear();
+		sweeps.clear();
+	}
+	if (sweep_edit->isChecked()) {
+		sweep(info, true);
 		return;
 	}
-
+	if (!job)
+		solve(reduce);
+
+	// only series are made again, storage and pyramids are kept
+	ScopedTimer timer("series");
+	timer.add_items(comp_choice->comps_size());
+	auto mode = OutputMode(output_edit->currentIndex());
+	auto storage = solution;
 	for (auto i = 0; i < comp_choice->comps_size(); i++) {
-		auto series = new QSplineSeries();
-		auto pen = series->pen();
-		pen.setWidth(2);
-		pen.setColor(color);
-		series->setPen(pen);
-
 		auto comp_pair = comp_choice->getComps(i);
 		auto x_comp = comp_pair.x_comp;
 		auto y_comp = comp_pair.y_comp;
 
-		auto get_value = [&solution, step](int comp, int k) {
-			return (comp == -1) ? k * step : solution[k][comp];
-		};
-		for (auto k = 0u; k < solution.size(); k++)
-			series->append({get_value(x_comp, k), get_value(y_comp, k)});
-
-		auto comp_name = [](int comp) {
-			return (comp == -1) ? "t" : "x_" + QString::number(comp);
-		};
+		QXYSeries *series;
+		if (mode == OutputMode::Trajectory) {
+			auto &pyramid = pyramids[{x_comp, y_comp}];
+			if (!pyramid)
+				pyramid = make_shared<LodPyramid>();
+			auto polyline =
+			  density_edit->isChecked() ?
+			    new DensitySeries(storage, x_comp, y_comp, pyramid) :
+			    new PolylineSeries(storage, x_comp, y_comp, pyramid);
+			connect(job, &SolveJob::appended, polyline,
+			        [polyline]() { polyline->grow(); });
+			series = polyline;
+			auto pen = series->pen();
+			pen.setWidth(2);
+			pen.setColor(color);
+			series->setPen(pen);
+		}
+		else {
+			// sections are small enough for usual Qt series
+			auto scatter = scatter_series(color);
+			auto append = [scatter, storage, x_comp, y_comp]() {
+				QList<QPointF> points;
+				storage->for_each_point(x_comp, y_comp, scatter->count(),
+				                        [&points](double x, double y) {
+					                        points.append({x, y});
+				                        });
+				scatter->append(points);
+				refit_axes(scatter->chart());
+			};
+			append(); // points of an earlier solve
+			connect(job, &SolveJob::appended, scatter, append);
+			series = scatter;
+		}
 		info[comp_name(x_comp) + "/" + comp_name(y_comp)].append(series);
 	}
 }
 
+void ChartDialogTab::sweep(SeriesInfo &info, bool compute)
+{
+	auto params = sweep_edit->get();
+	params.step = step_edit->value();
+	params.steps = steps_num_edit->value();
+	params.section = section_edit->text().toStdString();
+
+	for (auto i = 0; i < comp_choice->comps_size(); i++) {
+		auto y_comp = comp_choice->getComps(i).y_comp;
+		if (y_comp == -1) {
+			QMessageBox::warning(this, "Error", "Sweep component can't be t");
+			return;
+		}
+		params.component = y_comp;
+
+		if (!sweeps.contains(y_comp)) {
+			if (!compute)
+				continue;
+			ScopedTimer timer("bifurcation");
+			timer.add_items(params.count);
+			try {
+				sweeps[y_comp] = bifurcation_diagram(vp, init_value, params);
+			}
+			catch (exception &e) {
+				QMessageBox::warning(this, "Error", "Bifurcation sweep failed: " +
+				                                      QString(e.what()));
+				return;
+			}
+		}
+		auto &points = sweeps[y_comp];
+
+		auto series = scatter_series(color);
+		QVector<QPointF> cloud;
+		cloud.reserve(points.size());
+		for (auto &p : points)
+			cloud.append({p.parameter, p.value});
+		series->replace(cloud);
+		auto label = QString::fromStdString(params.parameter);
+		info[label + "/" + comp_name(y_comp)].append(series);
+	}
+}
+
 ChartDialogTab::operator json() const
 {
 	json result;
 
+	for (auto &[name, value] : param_edit->get())
+		result["parameters"][name.toStdString()] = value.toDouble();
+
 	for (auto &[name, formula] : aux_edit->get())
 		result["aux_vars"][name.toStdString()] = formula.toStdString();
 
@@ -336,11 +736,22 @@ ChartDialogTab::operator json() const
 	result["y_comp"] = comp_choice->getComps(0).y_comp;
 
 	result["color"] = color.name().toStdString();
+
+	result["output"] = output_edit->currentIndex();
+	result["section"] = section_edit->text().toStdString();
+	result["storage"] = storage_edit->currentIndex();
+	result["data_file"] = data_edit->text().toStdString();
+	result["density"] = density_edit->isChecked();
+	result["sweep"] = *sweep_edit;
 	return result;
 }
 
 void ChartDialogTab::from_json(const json &j)
 {
+	if (j.contains("parameters"))
+		for (auto &[name, value] : j["parameters"].items())
+			param_edit->add(QString::fromStdString(name),
+			                QString::number(value.get<double>(), 'g', 17));
 	try {
 		for (auto &[var, formula] : j.at("aux_vars").get<json::object_t>())
 			aux_edit->add(QString::fromStdString(var),
@@ -361,6 +772,14 @@ void ChartDialogTab::from_json(const json &j)
 	step_edit->setValue(j["step"]);
 	steps_num_edit->setValue(j["steps_num"]);
 
+	output_edit->setCurrentIndex(j.value("output", int(OutputMode::Trajectory)));
+	section_edit->setText(QString::fromStdString(j.value("section", ""s)));
+	storage_edit->setCurrentIndex(j.value("storage", int(StorageMode::Double)));
+	data_edit->setText(QString::fromStdString(j.value("data_file", ""s)));
+	density_edit->setChecked(j.value("density", false));
+	if (j.contains("sweep"))
+		sweep_edit->from_json(j["sweep"]);
+
 	color = QColor(j["color"].get<string>().c_str());
 	QPixmap pixmap(100, 100);
 	pixmap.fill(color);
@@ -373,16 +792,30 @@ SeriesInfo ChartDialog::getElements()
 		return {};
 
 	just_imported = false;
+	return elements();
+}
+
+SeriesInfo ChartDialog::elements(bool preview)
+{
 	SeriesInfo result;
 	for (auto &tab : tabs) {
 		if (!tab->check())
 			return {};
-		tab->get(result);
+		tab->get(result, preview);
 	}
 
 	return result;
 }
 
+QVector<ChartDialog::Parameter> ChartDialog::parameters() const
+{
+	QVector<Parameter> result;
+	for (auto i = 0; i < tabs.size(); i++)
+		for (auto &[name, value] : tabs[i]->parameters())
+			result.append({tabs[i], name, value, tab_widget->tabText(i)});
+	return result;
+}
+
 ChartDialog::ChartDialog(QWidget *p): QDialog(p)
 {
 	auto form = new QFormLayout(this);
@@ -396,6 +829,21 @@ ChartDialog::ChartDialog(QWidget *p): QDialog(p)
 	add_rm_layout->addWidget(remove_button);
 	form->addRow(add_rm_layout);
 
+	budget_edit = new QSpinBox(this);
+	budget_edit->setRange(16, 1 << 22);
+	budget_edit->setSuffix(" MB");
+	QSettings settings("drawcpp", "drawcpp");
+	budget_edit->setValue(
+	  settings.value("memory_budget_mb", int(default_memory_budget >> 20))
+	    .toInt());
+	connect(budget_edit, qOverload<int>(&QSpinBox::valueChanged), this,
+	        [this](int mb) {
+		        QSettings("drawcpp", "drawcpp").setValue("memory_budget_mb", mb);
+		        for (auto tab : tabs)
+			        tab->set_budget(budget());
+	        });
+	form->addRow("Memory budget per chart:", budget_edit);
+
 	auto buttonBox =
 	  new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel,
 	                       Qt::Horizontal, this);
@@ -409,6 +857,7 @@ ChartDialog::ChartDialog(QWidget *p): QDialog(p)
 void ChartDialog::add_tab()
 {
 	tabs.push_back(new ChartDialogTab(this));
+	tabs.back()->set_budget(budget());
 	tab_widget->addTab(tabs.back(), "Chart " + QString::number(tabs.size()));
 	tab_widget->setCurrentIndex(tabs.size() - 1);
 }
@@ -430,6 +879,14 @@ ChartDialog::operator json() const
 	return result;
 }
 
+size_t ChartDialog::memory() const
+{
+	auto result = 0uz;
+	for (auto tab : tabs)
+		result += tab->memory();
+	return result;
+}
+
 void ChartDialog::import(const json &info)
 {
 	for (auto i = 0; i < tabs.size(); i++)
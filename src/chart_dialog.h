@@ -6,15 +6,23 @@
 #include <QPushButton>
 #include <QSpinBox>
 #include <QVector>
+#include <QCheckBox>
 #include <QComboBox>
 #include <QDialog>
 #include <QFormLayout>
+#include <QGroupBox>
+#include <QLabel>
+#include <QPointer>
 #include <optional>
 #include <nlohmann/json.hpp>
 #include "formula_processor.h"
+#include "chart_spec.h"
 
 using SeriesInfo = std::map<QString, QVector<QtCharts::QAbstractSeries *>>;
 
+// Size in KB, MB or GB
+QString memory_text(size_t bytes);
+
 static const QString im_path = IMAGES_PATH;
 
 class AuxVarItem : public QWidget {
@@ -25,6 +33,7 @@ public:
 	AuxVarItem(QVBoxLayout *owner, const QString &n = "", const QString &f = "");
 	QString name() const { return name_edit->text(); }
 	QString formula() const { return formula_edit->text(); }
+	void set_formula(const QString &f) { formula_edit->setText(f); }
 };
 
 class AuxVarEdit : public QWidget {
@@ -33,7 +42,9 @@ class AuxVarEdit : public QWidget {
 public:
 	std::map<QString, QString> get() const;
 	void add(QString name, QString formula);
-	AuxVarEdit();
+	// Changes formula of an existing variable
+	void set(const QString &name, const QString &formula);
+	AuxVarEdit(const QString &add_text = "Add auxilliary");
 };
 
 class ChartDialogTab;
@@ -87,28 +98,90 @@ public:
 	friend class ChartDialogTab;
 };
 
+// Parameter sweep producing bifurcation diagram instead of trajectory
+class SweepEdit : public QGroupBox {
+	QLineEdit *param_edit;
+	QDoubleSpinBox *from_edit;
+	QDoubleSpinBox *to_edit;
+	QSpinBox *count_edit;
+	QSpinBox *transient_edit;
+	QComboBox *collect_edit;
+
+public:
+	SweepEdit(QWidget *parent);
+	// Fills everything but integration step and observation window
+	BifurcationParams get() const;
+	operator nlohmann::json() const;
+	void from_json(const nlohmann::json &j);
+};
+
+class SolveJob;
+class LodPyramid;
+
 class ChartDialogTab : public QWidget {
 	QPushButton *init_button;
+	AuxVarEdit *param_edit; // name = value, changed without parsing
 	AuxVarEdit *aux_edit;
 	EquationsEdit *equations_edit;
 	QDoubleSpinBox *step_edit;
 	QSpinBox *steps_num_edit;
+	QComboBox *output_edit;
+	QLineEdit *section_edit;
+	QComboBox *storage_edit;
+	QCheckBox *density_edit;
+	QLineEdit *data_edit; // solution is streamed there during integration
+	SweepEdit *sweep_edit;
 	InitEdit *init_edit;
 	QPushButton *color_button;
 	ComponentChoice *comp_choice;
+	QLabel *memory_label; // estimate of the trajectory
 
 	std::vector<double> init_value;
 	VectorProcessor vp;
+	// Section surface or stroboscopic period, parsed only to be checked.
+	// Solves parse section_edit again for their own copies of vp.
+	FormulaProcessor section;
 
 	QColor color;
+	size_t budget{default_memory_budget};
+
+	// Stages run parse -> solve -> view, each one only if its inputs differ
+	// from the ones of the last run. Keys are the inputs serialized.
+	std::string parsed_key;
+	std::string solved_key;
+	bool solved_preview{false}; // solution is coarse until a full get
+	SolveJob *job{nullptr}; // the last solve, may still be running
+	std::shared_ptr<const TrajectoryStorage> solution;
+	// Projections of solution drawn so far, by component pair
+	std::map<std::pair<int, int>, std::shared_ptr<LodPyramid>> pyramids;
+	std::map<int, std::vector<BifurcationPoint>> sweeps; // by component
+
+	std::string parse_key() const;
+	std::string solve_key() const;
+	// Values of param_edit go to the parsed processor
+	bool set_parameters();
+	// Previews take reduce times larger steps
+	void solve(int reduce);
+	// Diagrams which aren't computed yet are skipped unless compute is set
+	void sweep(SeriesInfo &info, bool compute);
+	// Decimation of trajectory for the memory budget
+	size_t keep_every() const;
+	void update_estimate();
 
 public:
 	bool check();
 	void comp_added(const QString &num);
 	void comp_removed();
-	void get(SeriesInfo &info);
+	// Preview is a coarse solve, quick enough for every move of a slider.
+	// Sweeps aren't computed for previews.
+	void get(SeriesInfo &info, bool preview = false);
+	std::map<QString, double> parameters() const;
+	void set_parameter(const QString &name, double value);
 	operator nlohmann::json() const;
 	void from_json(const nlohmann::json &j);
+	void set_budget(size_t bytes);
+	// Taken by solution and pyramids of its projections
+	size_t memory() const;
 
 	ChartDialogTab(QWidget *p);
 };
@@ -117,14 +190,27 @@ class ChartDialog : public QDialog {
 private:
 	bool just_imported{false};
 	QTabWidget *tab_widget;
+	QSpinBox *budget_edit; // MB per chart, kept in settings
 	QVector<ChartDialogTab *> tabs;
 	void add_tab();
 	void rm_tab();
 
 public:
+	struct Parameter {
+		QPointer<ChartDialogTab> tab; // tabs can be removed in the dialog
+		QString name;
+		double value;
+		QString chart; // title of the tab
+	};
+
 	SeriesInfo getElements();
+	// Series of the charts as they are set, without showing the dialog
+	SeriesInfo elements(bool preview = false);
+	QVector<Parameter> parameters() const;
 	operator nlohmann::json() const;
 	void import(const nlohmann::json &j);
+	size_t memory() const;
+	size_t budget() const { return size_t(budget_edit->value()) << 20; }
 
 	ChartDialog(QWidget *p);
 };
@@ -0,0 +1,59 @@
+#include <QFileInfo>
+#include <QImage>
+#include <QPdfWriter>
+#include <QSvgGenerator>
+#include "chart_export.h"
+
+using namespace QtCharts;
+
+// PDF is rasterized by viewers at about this resolution
+constexpr int pdf_dpi = 300;
+
+bool export_chart(QChartView &view, const QString &file,
+                  const std::function<void(QPainter &)> &decorate)
+{
+	auto size = view.viewport()->size();
+	auto paint = [&](QPainter &painter, const QRectF &target) {
+		painter.setRenderHints(view.renderHints());
+		view.render(&painter, target, view.viewport()->rect());
+		if (!decorate)
+			return;
+		painter.save();
+		painter.translate(target.topLeft());
+		painter.scale(target.width() / size.width(),
+		              target.height() / size.height());
+		decorate(painter);
+		painter.restore();
+	};
+
+	QPainter painter;
+	auto suffix = QFileInfo(file).suffix().toLower();
+	if (suffix == "svg") {
+		QSvgGenerator svg;
+		svg.setFileName(file);
+		svg.setSize(size);
+		svg.setViewBox(QRect(QPoint(), size));
+		if (!painter.begin(&svg))
+			return false;
+		paint(painter, QRectF(QPointF(), size));
+		return painter.end();
+	}
+	if (suffix == "pdf") {
+		// page is as big in points as the view in pixels
+		QPdfWriter pdf(file);
+		pdf.setResolution(pdf_dpi);
+		pdf.setPageSize(QPageSize(size, QPageSize::Point));
+		pdf.setPageMargins(QMarginsF());
+		if (!painter.begin(&pdf))
+			return false;
+		paint(painter, QRectF(0, 0, pdf.width(), pdf.height()));
+		return painter.end();
+	}
+
+	QImage image(size, QImage::Format_ARGB32);
+	image.fill(Qt::white);
+	painter.begin(&image);
+	paint(painter, QRectF(QPointF(), size));
+	painter.end();
+	return image.save(file);
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <QChartView>
+#include <QPainter>
+#include <QString>
+#include <functional>
+
+// Writes what the view shows in the format given by file suffix: svg, pdf or
+// png. Decorations are painted on top in viewport coordinates. Polylines are
+// simplified to the output resolution, so vector files stay small for any
+// trajectory length.
+bool export_chart(QtCharts::QChartView &view, const QString &file,
+                  const std::function<void(QPainter &)> &decorate = {});
@@ -0,0 +1,93 @@
+#include <stdexcept>
+#include "chart_spec.h"
+
+using namespace std;
+using namespace nlohmann;
+
+VectorProcessor ChartSpec::processor() const
+{
+	VectorProcessor vp;
+	auto i = 1z;
+	string var_name;
+	try {
+		for (auto &[name, value] : parameters) {
+			var_name = name;
+			vp.declare_parameter(name, value);
+		}
+		for (auto &eq : equations) {
+			var_name = default_variable + to_string(i);
+			vp[i++] = eq;
+		}
+		for (auto &[name, eq] : aux_vars) {
+			var_name = name;
+			vp[name] = eq;
+		}
+	}
+	catch (exception &e) {
+		throw runtime_error("Wrong equation format for variable " + var_name +
+		                    ": " + e.what());
+	}
+	return vp;
+}
+
+unique_ptr<TrajectoryStorage> ChartSpec::solve(size_t budget) const
+{
+	if (inits.size() != equations.size())
+		throw runtime_error("Initial conditions not set");
+	auto vp = processor();
+	auto result = make_storage(storage);
+	auto every = 1uz;
+	if (output == OutputMode::Trajectory)
+		every = decimation(
+		  memory_estimate(storage, equations.size(), steps_num + 1uz, 1), budget);
+	solve_output(vp, inits, step, steps_num, output, section, data_file, every,
+	             *result);
+	return result;
+}
+
+vector<BifurcationPoint> ChartSpec::bifurcation(unsigned threads) const
+{
+	if (inits.size() != equations.size())
+		throw runtime_error("Initial conditions not set");
+	if (y_comp == -1)
+		throw runtime_error("Sweep component can't be t");
+	auto params = sweep.value();
+	params.step = step;
+	params.steps = steps_num;
+	params.section = section;
+	params.component = y_comp;
+	params.threads = threads;
+	return bifurcation_diagram(processor(), inits, params);
+}
+
+void from_json(const json &j, ChartSpec &spec)
+{
+	if (j.contains("parameters"))
+		spec.parameters = j["parameters"].get<map<string, double>>();
+	if (j.contains("aux_vars"))
+		spec.aux_vars = j["aux_vars"].get<map<string, string>>();
+	spec.equations = j.at("equations").get<vector<string>>();
+	spec.inits = j.value("inits", vector<double>{});
+	spec.step = j.at("step");
+	spec.steps_num = j.at("steps_num");
+	spec.x_comp = j.value("x_comp", -1);
+	spec.y_comp = j.value("y_comp", 0);
+	spec.color = j.value("color", "#000000"s);
+	spec.output = OutputMode(j.value("output", 0));
+	spec.section = j.value("section", ""s);
+	spec.storage = StorageMode(j.value("storage", 0));
+	spec.data_file = j.value("data_file", ""s);
+	spec.density = j.value("density", false);
+
+	// the same keys SweepEdit writes
+	if (!j.contains("sweep") || !j["sweep"].value("enabled", false))
+		return;
+	auto &s = j["sweep"];
+	spec.sweep = BifurcationParams{
+	  .parameter = s.at("parameter"),
+	  .from = s.at("from"),
+	  .to = s.at("to"),
+	  .count = s.at("count"),
+	  .transient_steps = s.at("transient"),
+	  .collect = BifurcationCollect(s.at("collect").get<int>())};
+}
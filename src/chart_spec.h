@@ -0,0 +1,126 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "bifurcation.h"
+#include "formula_processor.h"
+#include "lod_pyramid.h"
+#include "section.h"
+#include "trajectory.h"
+#include "trajectory_file.h"
+#include "trace.h"
+
+// What part of the solution is kept for plotting
+enum class OutputMode {
+	Trajectory,   // every solver step
+	Section,      // crossings of section surface h(x) = 0
+	Stroboscopic, // samples with fixed period
+};
+
+// Solves the system passing the part chosen by mode to sink. Section is the
+// surface formula or the stroboscopic period.
+template<solution_sink Sink>
+void solve_output(VectorProcessor &vp, const std::vector<double> &init,
+                  double step, int steps_num, OutputMode mode,
+                  const std::string &section, Sink &sink,
+                  std::stop_token stop = {})
+{
+	ScopedTimer timer("solve");
+	auto rp = [&vp, &timer](double t, const std::vector<double> &x) {
+		timer.add_items(1); // evaluations of the right part
+		return vp(t, x);
+	};
+	EulerSolver solver(step, steps_num, init, rp);
+	if (mode == OutputMode::Trajectory) {
+		solver.solve(sink, stop);
+		return;
+	}
+	FormulaProcessor h(section, &vp);
+	if (mode == OutputMode::Section) {
+		auto surface = [&](const std::vector<double> &x) { return vp(h, x); };
+		PoincareSection crossings(surface, sink);
+		// surface reads t of vp, the right part sets it to the start of its
+		// step, so the time of the sample is set here
+		auto timed = [&vp, &crossings](double t, const std::vector<double> &x) {
+			vp.set_time(t);
+			crossings(t, x);
+		};
+		solver.solve(timed, stop);
+	}
+	else {
+		vp.set_time(0);
+		solver.solve(StroboscopicSection(vp(h, init), sink), stop);
+	}
+}
+
+// The same, also writing the output to data_file unless it's empty. Sink
+// gets only every k-th point, the file gets all of them.
+template<solution_sink Sink>
+void solve_output(VectorProcessor &vp, const std::vector<double> &init,
+                  double step, int steps_num, OutputMode mode,
+                  const std::string &section, const std::string &data_file,
+                  size_t every, Sink &sink, std::stop_token stop = {})
+{
+	Decimation decimated(every, sink);
+	if (data_file.empty()) {
+		solve_output(vp, init, step, steps_num, mode, section, decimated, stop);
+		return;
+	}
+	auto writer = make_writer(data_file);
+	TeeSink tee(decimated, *writer);
+	solve_output(vp, init, step, steps_num, mode, section, tee, stop);
+	writer->close();
+}
+
+// Memory limit of a chart unless user sets another one
+constexpr size_t default_memory_budget = size_t(2) << 30;
+
+// Upper bound of memory of trajectory chart: storage and pyramids of the
+// drawn projections
+inline size_t memory_estimate(StorageMode storage, size_t dimension,
+                              size_t points, size_t projections)
+{
+	return storage_estimate(storage, dimension, points) +
+	       projections * LodPyramid::memory_estimate(points);
+}
+
+// Every k-th point is kept, so that estimate fits in budget. Output is
+// decimated rather than the solve failing or the machine swapping.
+inline size_t decimation(size_t estimate, size_t budget)
+{
+	return (estimate <= budget) ? 1 : (estimate + budget - 1) / budget;
+}
+
+// Chart of a project file without the dialog widgets, used where there is
+// no GUI
+struct ChartSpec {
+	std::map<std::string, double> parameters;
+	std::map<std::string, std::string> aux_vars;
+	std::vector<std::string> equations;
+	std::vector<double> inits;
+	double step{};
+	int steps_num{};
+	int x_comp{-1};
+	int y_comp{0};
+	std::string color;
+	OutputMode output{OutputMode::Trajectory};
+	std::string section;
+	StorageMode storage{StorageMode::Double};
+	bool density{false}; // trajectory is drawn as density of points
+	std::string data_file; // solution is also streamed there if set
+	std::optional<BifurcationParams> sweep;
+
+	// Throws if a formula is wrong
+	VectorProcessor processor() const;
+	// Trajectory is decimated to fit in budget
+	std::unique_ptr<TrajectoryStorage>
+	solve(size_t budget = default_memory_budget) const;
+	// Diagram of y_comp, sweep must be set
+	std::vector<BifurcationPoint> bifurcation(unsigned threads = 0) const;
+};
+
+void from_json(const nlohmann::json &j, ChartSpec &spec);
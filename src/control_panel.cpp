@@ -3,10 +3,41 @@
 #include <QPdfWriter>
 #include <QBitmap>
 #include <QShortcut>
+#include <QMessageBox>
+#include <QTimer>
+#include <fstream>
 #include "widgets.h"
 #include "picture_panel.h"
+#include "trace.h"
 using namespace std;
 
+// Trace panel is refreshed this often
+constexpr int trace_refresh_ms = 500;
+// Stages shown in the panel, the rest are in its tooltip
+constexpr const char *shown_stages[] = {"parse", "solve", "series", "paint"};
+
+namespace {
+
+QString metric(double value)
+{
+	if (value >= 1e9)
+		return QString::number(value / 1e9, 'f', 1) + "G";
+	if (value >= 1e6)
+		return QString::number(value / 1e6, 'f', 1) + "M";
+	if (value >= 1e3)
+		return QString::number(value / 1e3, 'f', 1) + "k";
+	return QString::number(value, 'f', 0);
+}
+
+QString duration(int64_t us)
+{
+	if (us >= 1'000'000)
+		return QString::number(us / 1e6, 'f', 2) + " s";
+	return QString::number(us / 1e3, 'f', 1) + " ms";
+}
+
+} // namespace
+
 ControlPanel::ControlPanel(MainWindow *parent): QWidget(parent), mw(parent)
 {
 	QString images_prefix = IMAGES_PATH;
@@ -27,6 +58,11 @@ ControlPanel::ControlPanel(MainWindow *parent): QWidget(parent), mw(parent)
 	  new QPushButton(QIcon(images_prefix + "/images/graph.png"), "", this);
 	graph_button->setIconSize({48, 48});
 	coords_text = new QLabel("");
+	trace_text = new QLabel("");
+	auto trace_button = new QPushButton("Trace", this);
+	trace_button->setToolTip("Save timings as Chrome trace");
+	auto trace_timer = new QTimer(this);
+	trace_timer->start(trace_refresh_ms);
 
 	connect(open_button, &QPushButton::released, this, &ControlPanel::on_open);
 	connect(save_button, &QPushButton::released, this, &ControlPanel::on_save);
@@ -38,6 +74,9 @@ ControlPanel::ControlPanel(MainWindow *parent): QWidget(parent), mw(parent)
 	        [this]() { mw->picture_panel->zoomReset(); });
 	connect(graph_button, &QPushButton::released, this,
 	        [this]() { mw->picture_panel->graph_dialog(); });
+	connect(trace_button, &QPushButton::released, this,
+	        &ControlPanel::save_trace);
+	connect(trace_timer, &QTimer::timeout, this, &ControlPanel::update_trace);
 
 	auto save_as = new QShortcut(QKeySequence("Ctrl+Shift+S"), this);
 	connect(save_as, &QShortcut::activated, this, &ControlPanel::on_save);
@@ -56,13 +95,68 @@ ControlPanel::ControlPanel(MainWindow *parent): QWidget(parent), mw(parent)
 	layout->addWidget(unzoom_button);
 	layout->addWidget(graph_button);
 	layout->addStretch(1);
+	layout->addWidget(trace_text);
+	layout->addWidget(trace_button);
 	layout->addWidget(coords_text);
 }
 
+void ControlPanel::update_trace()
+{
+	auto stages = Trace::instance().stages();
+	auto counters = Trace::instance().counters();
+
+	QStringList shown;
+	for (auto name : shown_stages) {
+		auto it = stages.find(name);
+		if (it == stages.end())
+			continue;
+		auto &stage = it->second;
+		auto text = QString("%1 %2").arg(name).arg(duration(stage.last_us));
+		if (name == "solve"s && stage.total_us)
+			text += QString(", %1 eval/s")
+			          .arg(metric(stage.items * 1e6 / stage.total_us));
+		shown.append(text);
+	}
+	if (counters.contains("points"))
+		shown.append(metric(counters["points"]) + " points");
+	shown.append(memory_text(mw->picture_panel->memory()));
+	trace_text->setText(shown.join(" | "));
+
+	QStringList details{
+	  QString("memory: %1 used, %2 budget per chart")
+	    .arg(memory_text(mw->picture_panel->memory()))
+	    .arg(memory_text(mw->picture_panel->memory_budget()))};
+	for (auto &[name, stage] : stages)
+		details.append(QString("%1: %2 calls, %3 total, %4 max, %5 items, "
+		                       "%6 allocations")
+		                 .arg(QString::fromStdString(name))
+		                 .arg(stage.calls)
+		                 .arg(duration(stage.total_us))
+		                 .arg(duration(stage.max_us))
+		                 .arg(metric(stage.items))
+		                 .arg(metric(stage.allocations)));
+	for (auto &[name, value] : counters)
+		details.append(
+		  QString("%1: %2").arg(QString::fromStdString(name)).arg(value));
+	trace_text->setToolTip(details.join("\n"));
+}
+
+void ControlPanel::save_trace()
+{
+	auto filename = QFileDialog::getSaveFileName(this, "Save trace", "",
+	                                             "Chrome trace (*.json)");
+	if (!filename.size())
+		return;
+	ofstream ofs(filename.toStdString());
+	Trace::instance().write_chrome_trace(ofs);
+	if (!ofs)
+		QMessageBox::warning(this, "Error", "Can't write " + filename);
+}
+
 void ControlPanel::on_save()
 {
-	auto fileName = QFileDialog::getSaveFileName(this, "Save Project", "",
-	                                             "Save options (*.png *.json)");
+	auto fileName = QFileDialog::getSaveFileName(
+	  this, "Save Project", "", "Save options (*.png *.svg *.pdf *.json)");
 
 	if (!fileName.size())
 		return;
@@ -75,6 +169,11 @@ void ControlPanel::save(const QString &fileName)
 	if (fileName.endsWith("png")) {
 		mw->picture_panel->grab().save(fileName);
 	}
+	else if (fileName.endsWith("svg") || fileName.endsWith("pdf")) {
+		if (!mw->picture_panel->export_chart(fileName))
+			QMessageBox::warning(this, "Error", "Can't write " + fileName);
+		return;
+	}
 	else {
 		save_file = fileName;
 		QFileInfo fi(save_file);
@@ -0,0 +1,176 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "lod_pyramid.h"
+#include "trajectory.h"
+
+// Counts of projected points over a view rectangle split in width * height
+// bins. Row 0 is the top one, like in images.
+class Histogram {
+	double x_min{};
+	double x_max{};
+	double y_min{};
+	double y_max{};
+	int w{0};
+	int h{0};
+	double x_scale{};
+	double y_scale{};
+	std::vector<uint32_t> bins;
+
+public:
+	Histogram() = default;
+	Histogram(double x0, double x1, double y0, double y1, int width, int height)
+	  : x_min(x0), x_max(x1), y_min(y0), y_max(y1), w(width), h(height),
+	    x_scale(width / (x1 - x0)), y_scale(height / (y1 - y0)),
+	    bins(size_t(width) * height)
+	{
+	}
+
+	int width() const { return w; }
+	int height() const { return h; }
+	// Whether bins are the same as of histogram with these parameters
+	bool matches(double x0, double x1, double y0, double y1, int width,
+	             int height) const
+	{
+		return x_min == x0 && x_max == x1 && y_min == y0 && y_max == y1 &&
+		       w == width && h == height;
+	}
+	LodBox view() const
+	{
+		LodBox result;
+		result.add(x_min, y_min);
+		result.add(x_max, y_max);
+		return result;
+	}
+	double bin_width() const { return 1 / x_scale; }
+	double bin_height() const { return 1 / y_scale; }
+
+	void add(double x, double y, uint32_t count = 1)
+	{
+		auto i = std::floor((x - x_min) * x_scale);
+		auto j = std::floor((y_max - y) * y_scale);
+		if (i >= 0 && i < w && j >= 0 && j < h)
+			bins[size_t(j) * w + size_t(i)] += count;
+	}
+	void merge(const Histogram &other)
+	{
+		for (auto k = 0uz; k < bins.size(); k++)
+			bins[k] += other.bins[k];
+	}
+	void clear() { std::fill(bins.begin(), bins.end(), 0); }
+	uint32_t operator()(int i, int j) const { return bins[size_t(j) * w + i]; }
+	uint32_t max() const
+	{
+		return bins.empty() ? 0 : *std::max_element(bins.begin(), bins.end());
+	}
+	uint64_t total() const
+	{
+		uint64_t result = 0;
+		for (auto b : bins)
+			result += b;
+		return result;
+	}
+};
+
+// Logarithmic tone mapping of count to [0, 1], keeps sparse parts visible
+inline double tone(uint32_t count, uint32_t max)
+{
+	return max ? std::log1p(count) / std::log1p(max) : 0;
+}
+
+// Bins points of half-open index ranges. Ranges are split between threads,
+// every thread fills its own histogram, they are merged afterwards.
+inline void bin_ranges(Histogram &hist, const TrajectoryStorage &storage,
+                       int x_comp, int y_comp,
+                       const std::vector<std::pair<size_t, size_t>> &ranges,
+                       unsigned threads = 0)
+{
+	constexpr size_t chunk = 4096;
+	constexpr size_t min_points_per_thread = 1 << 16;
+
+	using Ranges = std::vector<std::pair<size_t, size_t>>;
+	auto bin = [&](Histogram &out, const Ranges &work) {
+		std::vector<double> xs(chunk), ys(chunk);
+		for (auto [first, last] : work) {
+			for (auto k = first; k < last; k += chunk) {
+				auto n = std::min(chunk, last - k);
+				storage.read(x_comp, k, n, xs.data());
+				storage.read(y_comp, k, n, ys.data());
+				for (auto i = 0uz; i < n; i++)
+					out.add(xs[i], ys[i]);
+			}
+		}
+	};
+
+	auto points = 0uz;
+	for (auto [first, last] : ranges)
+		points += last - first;
+	if (!threads)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = std::clamp<size_t>(points / min_points_per_thread, 1, threads);
+	if (threads == 1) {
+		bin(hist, ranges);
+		return;
+	}
+
+	// ranges are cut so that threads get about the same number of points
+	std::vector<Ranges> work(threads);
+	auto share = (points + threads - 1) / threads;
+	auto t = 0uz, taken = 0uz;
+	for (auto [first, last] : ranges) {
+		while (first < last) {
+			auto n = std::min(last - first, share - taken);
+			work[t].push_back({first, first + n});
+			first += n;
+			taken += n;
+			if (taken == share) {
+				t++;
+				taken = 0;
+			}
+		}
+	}
+
+	auto empty = hist;
+	empty.clear();
+	std::vector<Histogram> partial(threads, empty);
+	{
+		std::vector<std::jthread> workers;
+		for (auto i = 0uz; i < threads; i++)
+			workers.emplace_back([&, i]() { bin(partial[i], work[i]); });
+	}
+	for (auto &p : partial)
+		hist.merge(p);
+}
+
+// Bins all points using the pyramid. Nodes which fit in one bin are added
+// at once, so zooming out doesn't read the whole trajectory.
+inline void bin_all(Histogram &hist, const TrajectoryStorage &storage,
+                    const LodPyramid &pyramid, int x_comp, int y_comp,
+                    unsigned threads = 0)
+{
+	auto points = storage.size();
+	if (!points)
+		return;
+	// ranges are half-open, so the last point belongs to none of them
+	auto end = points - 1;
+	hist.add(storage.value(x_comp, end), storage.value(y_comp, end));
+
+	std::vector<std::pair<size_t, size_t>> leaves;
+	auto leaf = [&leaves](size_t first, size_t last) {
+		if (!leaves.empty() && leaves.back().second == first)
+			leaves.back().second = last;
+		else
+			leaves.push_back({first, last});
+	};
+	auto coarse = [&hist](size_t first, size_t last, const LodBox &box) {
+		hist.add((box.x_min + box.x_max) / 2, (box.y_min + box.y_max) / 2,
+		         last - first);
+	};
+	pyramid.query(hist.view(), hist.bin_width(), hist.bin_height(), leaf,
+	              coarse, [](size_t, size_t) {});
+	bin_ranges(hist, storage, x_comp, y_comp, leaves, threads);
+}
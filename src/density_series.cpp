@@ -0,0 +1,59 @@
+#include <QPainter>
+#include <cmath>
+#include "density_series.h"
+
+using namespace std;
+using namespace QtCharts;
+
+ProjectionItem *DensitySeries::make_item(QChart *chart)
+{
+	return new DensityItem(chart, this);
+}
+
+void DensityItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *,
+                        QWidget *)
+{
+	auto [x_axis, y_axis] = axes();
+	if (!series->isVisible() || !x_axis || !y_axis)
+		return;
+
+	auto plot = chart->plotArea();
+	auto resolution = device_resolution(painter);
+	int width = ceil(plot.width() * resolution);
+	int height = ceil(plot.height() * resolution);
+	if (width <= 0 || height <= 0)
+		return;
+
+	auto &storage = *series->storage;
+	auto points = storage.size();
+	if (!histogram.matches(x_axis->min(), x_axis->max(), y_axis->min(),
+	                       y_axis->max(), width, height)) {
+		histogram = Histogram(x_axis->min(), x_axis->max(), y_axis->min(),
+		                      y_axis->max(), width, height);
+		bin_all(histogram, storage, *series->pyramid, series->x_comp,
+		        series->y_comp);
+		binned = points;
+		image = {};
+	}
+	else if (binned < points) {
+		bin_ranges(histogram, storage, series->x_comp, series->y_comp,
+		           {{binned, points}});
+		binned = points;
+		image = {};
+	}
+
+	if (image.isNull()) {
+		image = QImage(width, height, QImage::Format_ARGB32_Premultiplied);
+		auto color = series->pen().color();
+		auto max = histogram.max();
+		for (auto j = 0; j < height; j++) {
+			auto line = reinterpret_cast<QRgb *>(image.scanLine(j));
+			for (auto i = 0; i < width; i++) {
+				int alpha = lround(255 * tone(histogram(i, j), max));
+				line[i] = qPremultiply(
+				  qRgba(color.red(), color.green(), color.blue(), alpha));
+			}
+		}
+	}
+	painter->drawImage(plot, image);
+}
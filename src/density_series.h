@@ -0,0 +1,27 @@
+#pragma once
+#include <QImage>
+#include "density.h"
+#include "polyline_series.h"
+
+// Projection drawn as density of points instead of a line, for attractors
+// where a polyline through millions of points is a solid blot
+class DensitySeries : public PolylineSeries {
+protected:
+	ProjectionItem *make_item(QtCharts::QChart *chart) override;
+
+public:
+	using PolylineSeries::PolylineSeries;
+};
+
+// Keeps histogram of the view at device resolution. New points are added to
+// it as they come, view changes bin everything again.
+class DensityItem : public ProjectionItem {
+	Histogram histogram;
+	size_t binned{0}; // points already in histogram
+	QImage image;
+
+public:
+	using ProjectionItem::ProjectionItem;
+	void paint(QPainter *painter, const QStyleOptionGraphicsItem *,
+	           QWidget *) override;
+};
@@ -1,16 +1,35 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <functional>
 #include <print>
+#include <utility>
 #include "formula_processor.h"
+#include "lookup_table.h"
 
 using namespace std;
 
+namespace {
+
+// Spaces mean nothing except in quoted file names
+void strip_spaces(string &formula)
+{
+	auto quoted = false;
+	erase_if(formula, [&quoted](char c) {
+		if (c == '"')
+			quoted = !quoted;
+		return c == ' ' && !quoted;
+	});
+}
+
+} // namespace
+
 FormulaProcessor::FormulaProcessor(string formula, VectorProcessor *vp)
   : owner(vp)
 {
-	formula.erase(remove(formula.begin(), formula.end(), ' '), formula.end());
-	auto op = operand(formula);
+	strip_spaces(formula);
+	// empty formula is zero
+	auto op = formula.empty() ? Operand{OperandType::Number} : operand(formula);
 	// Means formula is trivial i.e. no operations there
 	if (op.type != OperandType::Result)
 		trivial_operand = op;
@@ -19,8 +38,13 @@ FormulaProcessor::FormulaProcessor(string formula, VectorProcessor *vp)
 FormulaProcessor &FormulaProcessor::operator=(string formula)
 {
 	operations.clear();
-	formula.erase(remove(formula.begin(), formula.end(), ' '), formula.end());
-	auto op = operand(formula);
+	trivial_operand = {};
+	resolved = 0;
+	// formulas of owner may be held by reference and assigned after finalize
+	if (owner)
+		owner->finalized = false;
+	strip_spaces(formula);
+	auto op = formula.empty() ? Operand{OperandType::Number} : operand(formula);
 	// Means formula is trivial i.e. no operations there
 	if (op.type != OperandType::Result)
 		trivial_operand = op;
@@ -74,6 +98,8 @@ Operation FormulaProcessor::operation(OperationType type, string_view token,
 
 Operand FormulaProcessor::operand(string_view formula)
 {
+	if (formula.empty())
+		throw invalid_argument("Missing operand");
 	if (formula[0] == '-') {
 		// -formula == 0 - formula => create that operation
 		Operand zero = {.type = OperandType::Number, .value = 0.};
@@ -131,6 +157,9 @@ Operand FormulaProcessor::operand(string_view formula)
 		return {.type = OperandType::Result, .idx = operations.size() - 1};
 	}
 
+	if (formula.starts_with("table(") && formula.back() == ')')
+		return table(formula.substr(6, formula.size() - 7));
+
 	// TODO more functions with some cool template/std::func mappings
 	if (formula.starts_with("sign(")) {
 		auto f = formula.substr(5, formula.size() - 6); // strip sign()
@@ -141,6 +170,8 @@ Operand FormulaProcessor::operand(string_view formula)
 	auto idx = is_component(formula);
 	if (idx >= 0)
 		return {.type = OperandType::Variable, .idx = size_t(idx)};
+	if (formula == time_variable)
+		return {.type = OperandType::Time};
 
 	char *num_end;
 	auto num_value = strtod(begin(formula), &num_end);
@@ -150,114 +181,344 @@ Operand FormulaProcessor::operand(string_view formula)
 	if (!isalpha(formula[0]))
 		throw std::invalid_argument("Invalid operand: " + string{formula});
 
-	return {.type = OperandType::AuxVariable, .aux_variable = string{formula}};
+	string name{formula};
+	if (owner && owner->is_parameter(name))
+		return {.type = OperandType::Parameter,
+		        .idx = owner->parameter_slots[name]};
+	return {.type = OperandType::AuxVariable, .aux_variable = name};
 }
 
-double FormulaProcessor::operator()(const vector<double> &args)
+// "file", argument[, linear|cubic]
+Operand FormulaProcessor::table(string_view args)
+{
+	auto close = args.starts_with('"') ? args.find('"', 1) : string::npos;
+	if (close == string::npos || args.substr(close + 1, 1) != ",")
+		throw invalid_argument("Expected table(\"file\", argument)");
+	string path{args.substr(1, close - 1)};
+	auto argument = args.substr(close + 2);
+	auto cubic = false;
+	auto comma = find_next_token(argument, ",");
+	if (comma != string::npos) {
+		auto mode = argument.substr(comma + 1);
+		if (mode != "linear" && mode != "cubic")
+			throw invalid_argument("Table interpolation is linear or cubic, not " +
+			                       string{mode});
+		cubic = mode == "cubic";
+		argument = argument.substr(0, comma);
+	}
+	Operation op{OperationType::Table, {operand(argument)}};
+	op.table = make_shared<const LookupTable>(path);
+	op.cubic = cubic;
+	operations.push_back(std::move(op));
+	return {.type = OperandType::Result, .idx = operations.size() - 1};
+}
+
+void FormulaProcessor::bind_parameter(const string &name, size_t slot)
+{
+	auto bind = [&name, slot](Operand &o) {
+		if (o.type == OperandType::AuxVariable && o.aux_variable == name)
+			o = {.type = OperandType::Parameter, .idx = slot};
+	};
+	if (operations.empty())
+		bind(trivial_operand);
+	for (auto &operation : operations)
+		for (auto &o : operation.operands)
+			bind(o);
+}
+
+void FormulaProcessor::resolve(size_t dimension, const string &where)
 {
-	vector<double> results;
-	auto value = [&args, &results, this](const Operand &o) {
+	variables = 0;
+	auto check = [&](Operand &o) {
 		switch (o.type) {
+		case OperandType::NONE:
+			throw invalid_argument("Missing operand in " + where);
+		case OperandType::Variable:
+			if (o.idx >= dimension)
+				throw invalid_argument(
+				  format("{}{} in {} is out of {} components", default_variable,
+				         o.idx + 1, where, dimension));
+			variables = max(variables, o.idx + 1);
+			break;
+		case OperandType::Time:
+			if (!owner)
+				throw invalid_argument("t in " + where + " needs a system");
+			break;
 		case OperandType::AuxVariable:
-			if (!is_aux_var(o.aux_variable))
-				throw runtime_error("Aux variable failure for " + o.aux_variable);
-			if (owner->calculated_aux.contains(o.aux_variable))
-				return owner->calculated_aux[o.aux_variable];
-			if (owner->current_aux.contains(o.aux_variable))
-				throw runtime_error("Circular definition of aux variable " +
-				                    o.aux_variable);
-			owner->current_aux.insert(o.aux_variable);
-			owner->calculated_aux[o.aux_variable] =
-			  owner->aux_variables[o.aux_variable](args);
-			return owner->calculated_aux[o.aux_variable];
+			if (!owner || !owner->aux_variables.contains(o.aux_variable))
+				throw invalid_argument("Unknown variable " + o.aux_variable +
+				                       " in " + where);
+			o.idx = owner->aux_index(o.aux_variable);
+			break;
+		default:
+			break;
+		}
+	};
+
+	if (operations.empty())
+		check(trivial_operand);
+	for (auto &operation : operations) {
+		auto count = operation.operands.size();
+		switch (operation.type) {
+		case OperationType::Tern:
+			if (count != 3)
+				throw invalid_argument("Malformed ternary operator in " + where);
+			break;
+		case OperationType::Gr:
+		case OperationType::Ls:
+		case OperationType::Pow:
+			if (count != 2)
+				throw invalid_argument(format(
+				  "{} takes two operands in {}, use brackets", char(operation.type),
+				  where));
+			break;
+		default:
+			break;
+		}
+		for (auto &o : operation.operands)
+			check(o);
+	}
+	results.resize(operations.size());
+	resolved = owner ? owner->generation : 1;
+}
+
+double FormulaProcessor::evaluate(const double *args) noexcept
+{
+	auto value = [args, this](const Operand &o) noexcept {
+		switch (o.type) {
 		case OperandType::Number:
 			return o.value;
 		case OperandType::Result:
 			return results[o.idx];
 		case OperandType::Variable:
-			return args.at(o.idx);
-		default:
-			throw runtime_error("Bad operand");
+			return args[o.idx];
+		case OperandType::Parameter:
+			return owner->parameter_values[o.idx];
+		case OperandType::Time:
+			return owner->time;
+		case OperandType::AuxVariable:
+			return owner->aux_value(o.idx, args);
+		case OperandType::NONE: // rejected by resolve
+			break;
 		}
+		unreachable();
 	};
 
 	if (!operations.size())
 		return value(trivial_operand);
 
-	for (auto operation : operations) {
-		// cerr << static_cast<int>(op.type) << " " << op.operand1_idx << '\n';
-		auto &operands = operation.operands;
-		switch (operation.type) {
+	for (auto i = 0uz; i < operations.size(); i++) {
+		auto &operands = operations[i].operands;
+		double result{};
+		switch (operations[i].type) {
 		case OperationType::Plus:
-			results.push_back(0);
-			for (auto operand : operands)
-				results.back() += value(operand);
+			result = 0;
+			for (auto &operand : operands)
+				result += value(operand);
 			break;
 		case OperationType::Minus:
-			results.push_back(value(operands[0]));
+			result = value(operands[0]);
 			for (auto j = 1u; j < operands.size(); j++)
-				results.back() -= value(operands[j]);
+				result -= value(operands[j]);
 			break;
 		case OperationType::Times:
-			results.push_back(1);
-			for (auto operand : operands)
-				results.back() *= value(operand);
+			result = 1;
+			for (auto &operand : operands)
+				result *= value(operand);
 			break;
 		case OperationType::Div:
-			results.push_back(value(operands[0]));
+			result = value(operands[0]);
 			for (auto j = 1u; j < operands.size(); j++)
-				results.back() /= value(operands[j]);
+				result /= value(operands[j]);
 			break;
 		case OperationType::Or:
-			results.push_back(false);
-			for (auto operand : operands)
-				results.back() = results.back() || value(operand);
+			result = false;
+			for (auto &operand : operands)
+				result = result || value(operand);
 			break;
 		case OperationType::And:
-			results.push_back(true);
-			for (auto operand : operands)
-				results.back() = results.back() && value(operand);
+			result = true;
+			for (auto &operand : operands)
+				result = result && value(operand);
 			break;
 		case OperationType::Tern:
-			results.push_back(value(operands[0]) ? value(operands[1]) :
-			                                       value(operands[2]));
+			result = value(operands[0]) ? value(operands[1]) : value(operands[2]);
 			break;
 		case OperationType::Gr:
-			results.push_back(value(operands[0]) > value(operands[1]));
+			result = value(operands[0]) > value(operands[1]);
 			break;
 		case OperationType::Ls:
-			results.push_back(value(operands[0]) < value(operands[1]));
+			result = value(operands[0]) < value(operands[1]);
 			break;
 		case OperationType::Pow:
-			results.push_back(pow(value(operands[0]), value(operands[1])));
+			result = pow(value(operands[0]), value(operands[1]));
 			break;
 		case OperationType::Abs:
-			results.push_back(abs(value(operands[0])));
+			result = abs(value(operands[0]));
 			break;
 		case OperationType::Sign:
-			results.push_back(value(operands[0]) > 0 ? 1 : -1);
+			result = value(operands[0]) > 0 ? 1 : -1;
 			break;
+		case OperationType::Table: {
+			auto &op = operations[i];
+			result = (*op.table)(value(operands[0]), op.cursor, op.cubic);
+			break;
+		}
 		}
-		// cout << operands[op.result_idx] << '\n';
+		results[i] = result;
 	}
 	return results.back();
 }
 
-vector<double> VectorProcessor::operator()(const vector<double> &args)
+double FormulaProcessor::operator()(const vector<double> &args)
 {
-	vector<double> result;
-	current_aux.clear();
-	calculated_aux.clear();
+	if (owner)
+		return (*owner)(*this, args);
+	if (!resolved)
+		resolve(-1uz, "formula");
+	if (args.size() < variables)
+		throw invalid_argument(format("Formula needs {} variables, {} given",
+		                              variables, args.size()));
+	return evaluate(args.data());
+}
 
-	for (auto &component : components)
-		result.push_back(component(args));
+double VectorProcessor::aux_value(size_t idx, const double *args) noexcept
+{
+	if (!aux_ready[idx]) {
+		aux_values[idx] = aux_list[idx]->evaluate(args);
+		aux_ready[idx] = true;
+	}
+	return aux_values[idx];
+}
 
+size_t VectorProcessor::aux_index(const string &name) const
+{
+	return distance(aux_variables.begin(), aux_variables.find(name));
+}
+
+void VectorProcessor::finalize()
+{
+	if (finalized)
+		return;
+	generation++;
+	aux_list.clear();
+	for (auto &[name, aux] : aux_variables)
+		aux_list.push_back(&aux);
+	aux_values.assign(aux_list.size(), 0);
+	aux_ready.assign(aux_list.size(), false);
+
+	variables = 0;
+	for (auto &[name, aux] : aux_variables) {
+		aux.resolve(dimension(), name);
+		variables = max(variables, aux.variables);
+	}
+	for (auto i = 0uz; i < components.size(); i++) {
+		components[i].resolve(dimension(),
+		                      format("d{}{}", default_variable, i + 1));
+		variables = max(variables, components[i].variables);
+	}
+	check_cycles();
+	finalized = true;
+}
+
+void VectorProcessor::resolve(FormulaProcessor &f, const string &where)
+{
+	assert(f.owner == this && "Formula must be parsed for this processor");
+	finalize();
+	if (f.resolved != generation)
+		f.resolve(dimension(), where);
+}
+
+void VectorProcessor::check_cycles() const
+{
+	// depth first search, a variable on the current path can't be reached again
+	enum State : char { New, OnPath, Done };
+	vector<State> state(aux_list.size(), New);
+	function<void(size_t)> visit = [&](size_t idx) {
+		if (state[idx] == Done)
+			return;
+		if (state[idx] == OnPath) {
+			auto it = next(aux_variables.begin(), idx);
+			throw runtime_error("Circular definition of aux variable " +
+			                    it->first);
+		}
+		state[idx] = OnPath;
+		auto formula = aux_list[idx];
+		auto follow = [&visit](const Operand &o) {
+			if (o.type == OperandType::AuxVariable)
+				visit(o.idx);
+		};
+		if (formula->operations.empty())
+			follow(formula->trivial_operand);
+		for (auto &operation : formula->operations)
+			for (auto &o : operation.operands)
+				follow(o);
+		state[idx] = Done;
+	};
+	for (auto i = 0uz; i < aux_list.size(); i++)
+		visit(i);
+}
+
+void VectorProcessor::evaluate(const double *args, double *result) noexcept
+{
+	fill(aux_ready.begin(), aux_ready.end(), false);
+	for (auto i = 0uz; i < components.size(); i++)
+		result[i] = components[i].evaluate(args);
+}
+
+vector<double> VectorProcessor::operator()(const vector<double> &args)
+{
+	finalize();
+	if (args.size() < variables)
+		throw invalid_argument(format("Equations need {} variables, {} given",
+		                              variables, args.size()));
+	vector<double> result(components.size());
+	evaluate(args.data(), result.data());
 	return result;
 }
 
+double VectorProcessor::operator()(FormulaProcessor &f,
+                                   const vector<double> &args)
+{
+	resolve(f);
+	if (args.size() < max(variables, f.variables))
+		throw invalid_argument(format("Formula needs {} variables, {} given",
+		                              max(variables, f.variables), args.size()));
+	fill(aux_ready.begin(), aux_ready.end(), false);
+	return f.evaluate(args.data());
+}
+
+VectorProcessor::VectorProcessor(const VectorProcessor &other)
+  : components(other.components), aux_variables(other.aux_variables),
+    parameter_values(other.parameter_values),
+    parameter_slots(other.parameter_slots)
+{
+	rebind();
+}
+
+VectorProcessor &VectorProcessor::operator=(const VectorProcessor &other)
+{
+	components = other.components;
+	aux_variables = other.aux_variables;
+	parameter_values = other.parameter_values;
+	parameter_slots = other.parameter_slots;
+	finalized = false;
+	rebind();
+	return *this;
+}
+
+void VectorProcessor::rebind()
+{
+	for (auto &component : components)
+		component.owner = this;
+	for (auto &[name, aux] : aux_variables)
+		aux.owner = this;
+}
+
 FormulaProcessor &VectorProcessor::operator[](size_t i)
 {
 	assert(i && "Vector processor uses indexing with i > 0");
+	finalized = false; // the formula may be assigned
 	if (components.size() < i)
 		components.resize(i, {""s, this});
 	return components[i - 1];
@@ -265,11 +526,61 @@ FormulaProcessor &VectorProcessor::operator[](size_t i)
 
 FormulaProcessor &VectorProcessor::operator[](const std::string &name)
 {
+	if (is_parameter(name))
+		throw invalid_argument(name + " is a parameter, not aux variable");
+	if (name == time_variable)
+		throw invalid_argument("t is time, not aux variable");
+	finalized = false;
 	if (!aux_variables.contains(name))
 		aux_variables.insert({name, {"", this}});
 	return aux_variables[name];
 }
 
+size_t VectorProcessor::declare_parameter(const string &name, double value)
+{
+	if (name.empty() || !isalpha(name[0]) || name == time_variable ||
+	    FormulaProcessor().is_component(name) >= 0)
+		throw invalid_argument("Invalid parameter name: " + name);
+	if (aux_variables.contains(name))
+		throw invalid_argument(name + " is already an aux variable");
+
+	auto [it, added] = parameter_slots.insert({name, parameter_values.size()});
+	if (!added) {
+		parameter_values[it->second] = value;
+		return it->second;
+	}
+	parameter_values.push_back(value);
+	finalized = false;
+	for (auto &component : components)
+		component.bind_parameter(name, it->second);
+	for (auto &[aux_name, aux] : aux_variables)
+		aux.bind_parameter(name, it->second);
+	return it->second;
+}
+
+size_t VectorProcessor::aux_to_parameter(const string &name, double value)
+{
+	if (!aux_variables.erase(name))
+		throw invalid_argument("Unknown variable " + name);
+	return declare_parameter(name, value);
+}
+
+void VectorProcessor::set_parameter(const string &name, double value)
+{
+	auto it = parameter_slots.find(name);
+	if (it == parameter_slots.end())
+		throw invalid_argument("Unknown parameter " + name);
+	parameter_values[it->second] = value;
+}
+
+double VectorProcessor::parameter(const string &name) const
+{
+	auto it = parameter_slots.find(name);
+	if (it == parameter_slots.end())
+		throw invalid_argument("Unknown parameter " + name);
+	return parameter_values[it->second];
+}
+
 int FormulaProcessor::is_component(string_view name) const
 {
 	if (!name.starts_with(default_variable))
@@ -282,10 +593,3 @@ int FormulaProcessor::is_component(string_view name) const
 		return -1;
 	return num - 1;
 }
-
-bool FormulaProcessor::is_aux_var(const string &name) const
-{
-	if (!owner)
-		return false;
-	return owner->is_aux_var(name);
-}
@@ -1,5 +1,5 @@
 #pragma once
-#include <set>
+#include <memory>
 #include <stdexcept>
 #include <vector>
 #include <string>
@@ -24,6 +24,7 @@ enum class OperationType {
 	And = 'A', // logical, &&
 	Or = 'O',  // logical, ||
 	Sign = 'S',
+	Table = 'T', // table("file", argument[, linear|cubic])
 };
 
 inline OperationType OType(const std::string_view &token)
@@ -44,34 +45,50 @@ enum class OperandType {
 	Number,
 	Variable,
 	AuxVariable,
+	Parameter, // slot of VectorProcessor parameters
+	Time,      // t, set by the solver
 };
 
 struct Operand {
-	OperandType type;
-	size_t idx{};
+	OperandType type{OperandType::NONE};
+	size_t idx{}; // also of aux variable, once it is resolved
 	double value{};
 	std::string aux_variable{};
 };
 
+class LookupTable;
+
 struct Operation {
 	OperationType type;
 	// Indexes in operands vector
 	std::vector<Operand> operands{};
+	// Of OperationType::Table, shared by copies of the formula
+	std::shared_ptr<const LookupTable> table{};
+	bool cubic{false};
+	size_t cursor{0}; // interval of the last lookup
 };
 
 class VectorProcessor;
 
 constexpr char default_variable[] = "x";
+constexpr char time_variable[] = "t";
 
 class FormulaProcessor {
+	friend class VectorProcessor;
+
 private:
-	VectorProcessor *owner;
+	VectorProcessor *owner{nullptr};
 	int is_component(std::string_view name) const;
-	bool is_aux_var(const std::string &name) const;
-	// If processor is trivial it contains just one operand
+	// If processor is trivial it contains just one operand, only used when
+	// there are no operations
 	Operand trivial_operand;
 
 	std::vector<Operation> operations;
+	std::vector<double> results; // of operations, while evaluating
+
+	// Generation of owner the formula was resolved for, 0 if it wasn't
+	unsigned resolved{0};
+	size_t variables{0}; // components read, up to the last one
 
 	Operand operand(std::string_view formula);
 	Operation operation(OperationType op, std::string_view token,
@@ -81,11 +98,21 @@ private:
 	                                       std::string::size_type pos = 0);
 
 	bool inside_section(std::string_view formula, std::string::size_type pos);
+	// Arguments of table() without the brackets, the file is loaded here
+	Operand table(std::string_view args);
+	// Aux variable operands with this name are turned into parameter slot
+	void bind_parameter(const std::string &name, size_t slot);
+	// Checks the program and turns names of aux variables into their indexes.
+	// Throws if it can't be evaluated, where is the name of the formula.
+	void resolve(size_t dimension, const std::string &where);
+	// Formula must be resolved and args must hold its variables
+	double evaluate(const double *args) noexcept;
 
 public:
 	FormulaProcessor(std::string formula, VectorProcessor * = nullptr);
 	FormulaProcessor &operator=(std::string formula);
 	FormulaProcessor() = default;
+	// Checked evaluation, aux variables are evaluated by owner
 	double operator()(const std::vector<double> &);
 };
 
@@ -96,20 +123,75 @@ private:
 	std::vector<FormulaProcessor> components;
 	std::map<std::string, FormulaProcessor> aux_variables;
 
-	// we need to avoid circular aux dependencies
-	// if we need unevaluated aux variable we add it to this set and evaluate
-	// if it already is in the set => we have a circular dependency => error
-
-	std::set<std::string> current_aux;
-	std::map<std::string, double> calculated_aux;
-	bool is_aux_var(std::string name) { return aux_variables.contains(name); }
+	// Set by finalize, cleared by anything that may change the formulas
+	bool finalized{false};
+	unsigned generation{0}; // of the last finalize, formulas resolved for it
+	size_t variables{0};    // components read by the formulas
+	// Aux variables by index of operands, each evaluated once per call
+	std::vector<FormulaProcessor *> aux_list;
+	std::vector<double> aux_values;
+	std::vector<char> aux_ready;
+	double aux_value(size_t idx, const double *args) noexcept;
+	size_t aux_index(const std::string &name) const;
+	void check_cycles() const;
+
+	std::vector<double> parameter_values;
+	std::map<std::string, size_t> parameter_slots;
+	double time{0};
+	// Formulas refer to aux variables through owner, so copies must point to
+	// their own processor
+	void rebind();
 
 public:
+	// Finalizes the processor if it was changed, then the formulas are
+	// evaluated without any checks
 	std::vector<double> operator()(const std::vector<double> &);
+	// The same for time dependent systems, formulas read it as t
+	std::vector<double> operator()(double t, const std::vector<double> &x)
+	{
+		time = t;
+		return (*this)(x);
+	}
+	void set_time(double t) { time = t; }
+	// Evaluates standalone formula which may refer to aux variables of this
+	// processor
+	double operator()(FormulaProcessor &f, const std::vector<double> &);
+	// Checks every formula: components exist, names are known, aux variables
+	// aren't defined through themselves. Throws on the first error.
+	void finalize();
+	// The same for standalone formula parsed for this processor, where names
+	// it in errors
+	void resolve(FormulaProcessor &f, const std::string &where = "formula");
+	// Unchecked evaluation of a finalized processor, args hold every
+	// component the formulas read
+	void evaluate(const double *args, double *result) noexcept;
+	size_t dimension() const { return components.size(); }
 	FormulaProcessor &operator[](size_t i);
 	FormulaProcessor &operator[](const std::string &name);
+	bool contains(const std::string &name) const
+	{
+		return aux_variables.contains(name);
+	}
+
+	// Parameters are constants changed without parsing anything. Formulas
+	// refer to them by name like to aux variables, whether they were parsed
+	// before or after the declaration, and read the value from a slot.
+	// Copies of the processor have their own values.
+	size_t declare_parameter(const std::string &name, double value = 0);
+	// Aux variable is replaced by a parameter of the same name
+	size_t aux_to_parameter(const std::string &name, double value = 0);
+	bool is_parameter(const std::string &name) const
+	{
+		return parameter_slots.contains(name);
+	}
+	void set_parameter(size_t slot, double value)
+	{
+		parameter_values.at(slot) = value;
+	}
+	void set_parameter(const std::string &name, double value);
+	double parameter(const std::string &name) const;
 
 	VectorProcessor() = default;
-	VectorProcessor(const VectorProcessor &) = default;
-	VectorProcessor &operator=(const VectorProcessor &other) = default;
+	VectorProcessor(const VectorProcessor &);
+	VectorProcessor &operator=(const VectorProcessor &other);
 };
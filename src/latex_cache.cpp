@@ -0,0 +1,187 @@
+#include <QApplication>
+#include <QBitmap>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QPointer>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QThreadPool>
+#include <algorithm>
+#include <optional>
+#include "latex_cache.h"
+#include "trace.h"
+
+// Memory cache limit in kilobytes
+constexpr int memory_limit = 64 * 1024;
+
+// In kilobytes, small formulas count too, so that the limit holds
+static int cost(const QImage &image)
+{
+	return std::max<qsizetype>(1, image.sizeInBytes() / 1024);
+}
+
+LatexCache::LatexCache()
+  : images(memory_limit),
+    dir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+        "/latex")
+{
+	QDir().mkpath(dir);
+}
+
+LatexCache &LatexCache::instance()
+{
+	static LatexCache cache;
+	return cache;
+}
+
+QByteArray LatexCache::key(const KLFBackend::klfInput &input)
+{
+	QCryptographicHash hash(QCryptographicHash::Sha256);
+	for (auto &field : {input.latex, input.mathmode, input.preamble}) {
+		hash.addData(field.toUtf8());
+		hash.addData("\0", 1);
+	}
+	hash.addData(QByteArray::number(double(input.fontsize)));
+	hash.addData(QByteArray::number(qulonglong(input.fg_color)));
+	hash.addData(QByteArray::number(qulonglong(input.bg_color)));
+	hash.addData(QByteArray::number(int(input.dpi)));
+	return hash.result().toHex();
+}
+
+QString LatexCache::file(const QByteArray &key) const
+{
+	return dir + "/" + QString::fromLatin1(key) + ".png";
+}
+
+// Disk is used without the lock, so a slow one doesn't block lookups of
+// other threads
+QImage LatexCache::find(const QByteArray &key)
+{
+	{
+		QMutexLocker lock(&mutex);
+		if (auto image = images.object(key))
+			return *image;
+	}
+	QImage image(file(key));
+	if (!image.isNull()) {
+		QMutexLocker lock(&mutex);
+		images.insert(key, new QImage(image), cost(image));
+	}
+	return image;
+}
+
+void LatexCache::insert(const QByteArray &key, const QImage &image)
+{
+	{
+		QMutexLocker lock(&mutex);
+		images.insert(key, new QImage(image), cost(image));
+	}
+	// readers see either no file or the whole one
+	QSaveFile out(file(key));
+	if (out.open(QIODevice::WriteOnly) && image.save(&out, "PNG"))
+		out.commit();
+}
+
+static bool load_settings(KLFBackend::klfSettings &settings)
+{
+	QSettings stored("drawcpp", "drawcpp");
+	stored.beginGroup("latex");
+	settings.latexexec = stored.value("latex").toString();
+	settings.dvipsexec = stored.value("dvips").toString();
+	settings.gsexec = stored.value("gs").toString();
+	settings.epstopdfexec = stored.value("epstopdf").toString();
+	for (auto &exe : {settings.latexexec, settings.dvipsexec, settings.gsexec})
+		if (exe.isEmpty() || !QFileInfo(exe).isExecutable())
+			return false;
+	settings.tempdir = QDir::tempPath();
+	return true;
+}
+
+static void store_settings(const KLFBackend::klfSettings &settings)
+{
+	QSettings stored("drawcpp", "drawcpp");
+	stored.beginGroup("latex");
+	stored.setValue("latex", settings.latexexec);
+	stored.setValue("dvips", settings.dvipsexec);
+	stored.setValue("gs", settings.gsexec);
+	stored.setValue("epstopdf", settings.epstopdfexec);
+}
+
+const KLFBackend::klfSettings *latex_settings()
+{
+	static auto settings = []() -> std::optional<KLFBackend::klfSettings> {
+		KLFBackend::klfSettings result;
+		if (load_settings(result))
+			return result;
+		if (!KLFBackend::detectSettings(&result))
+			return {};
+		store_settings(result);
+		return result;
+	}();
+	return settings ? &*settings : nullptr;
+}
+
+KLFBackend::klfInput latex_input()
+{
+	KLFBackend::klfInput input;
+	input.mathmode = "\\begin{equation*} ... \\end{equation*}";
+	input.preamble = "\\usepackage{amsmath}\n";
+	input.dpi = 300;
+	return input;
+}
+
+QImage render_latex(const KLFBackend::klfInput &input,
+                    const KLFBackend::klfSettings &settings)
+{
+	auto &cache = LatexCache::instance();
+	auto key = LatexCache::key(input);
+	auto image = cache.find(key);
+	if (!image.isNull())
+		return image;
+
+	ScopedTimer timer("latex");
+	auto out = KLFBackend::getLatexFormula(input, settings);
+	if (!out.status && !out.result.isNull())
+		cache.insert(key, out.result);
+	return out.result;
+}
+
+static QThreadPool &latex_pool()
+{
+	static QThreadPool pool;
+	return pool;
+}
+
+void render_latex_async(const KLFBackend::klfInput &input, QObject *receiver,
+                        std::function<void(QImage)> done)
+{
+	QPointer<QObject> guard(receiver);
+	latex_pool().start([input, guard, done]() {
+		QImage image;
+		if (auto settings = latex_settings()) {
+			// every worker runs TeX tools in its own directory
+			QTemporaryDir tmp;
+			auto worker_settings = *settings;
+			if (tmp.isValid())
+				worker_settings.tempdir = tmp.path();
+			image = render_latex(input, worker_settings);
+		}
+		QMetaObject::invokeMethod(
+		  qApp,
+		  [guard, done, image]() {
+			  if (guard)
+				  done(image);
+		  },
+		  Qt::QueuedConnection);
+	});
+}
+
+QPixmap latex_pixmap(const QImage &image)
+{
+	auto pm = QPixmap::fromImage(image);
+	pm.setMask(pm.createMaskFromColor("white"));
+	return pm;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <QByteArray>
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QPixmap>
+#include <QString>
+#include <functional>
+#include <klfbackend.h>
+
+// Rendered latex formulas keyed by everything affecting the picture. Kept in
+// memory and in the user cache directory, so a label is rendered by the TeX
+// tools only once. Safe to use from any thread.
+class LatexCache {
+	QMutex mutex;
+	QCache<QByteArray, QImage> images;
+	QString dir;
+
+	LatexCache();
+	QString file(const QByteArray &key) const;
+
+public:
+	static LatexCache &instance();
+	static QByteArray key(const KLFBackend::klfInput &input);
+
+	// Null image if formula wasn't rendered before
+	QImage find(const QByteArray &key);
+	void insert(const QByteArray &key, const QImage &image);
+};
+
+// Paths of TeX tools, detected once per process on the first call and kept
+// in QSettings, so later runs only check that the programs are still there.
+// Null if tools aren't installed. Detection may take seconds, so GUI thread
+// should leave it to render_latex_async.
+const KLFBackend::klfSettings *latex_settings();
+
+// Formatting shared by all labels, latex and fontsize are left to caller
+KLFBackend::klfInput latex_input();
+
+// Renders formula or takes it from cache, may be called from any thread
+QImage render_latex(const KLFBackend::klfInput &input,
+                    const KLFBackend::klfSettings &settings);
+
+// Renders formula on a worker thread with latex_settings, done is called in
+// GUI thread unless receiver is destroyed before that. Image is null if
+// rendering failed.
+void render_latex_async(const KLFBackend::klfInput &input, QObject *receiver,
+                        std::function<void(QImage)> done);
+
+// White background becomes transparent, GUI thread only
+QPixmap latex_pixmap(const QImage &image);
@@ -0,0 +1,174 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "trajectory.h"
+
+// Float boxes are rounded outwards, so they always contain the points
+inline float round_down(double v)
+{
+	float f = v;
+	return (f > v) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) :
+	                 f;
+}
+
+inline float round_up(double v)
+{
+	float f = v;
+	return (f < v) ? std::nextafter(f, std::numeric_limits<float>::infinity()) :
+	                 f;
+}
+
+struct LodBox {
+	float x_min{std::numeric_limits<float>::infinity()};
+	float x_max{-std::numeric_limits<float>::infinity()};
+	float y_min{std::numeric_limits<float>::infinity()};
+	float y_max{-std::numeric_limits<float>::infinity()};
+
+	void add(double x, double y)
+	{
+		x_min = std::min(x_min, round_down(x));
+		x_max = std::max(x_max, round_up(x));
+		y_min = std::min(y_min, round_down(y));
+		y_max = std::max(y_max, round_up(y));
+	}
+	void add(const LodBox &b)
+	{
+		x_min = std::min(x_min, b.x_min);
+		x_max = std::max(x_max, b.x_max);
+		y_min = std::min(y_min, b.y_min);
+		y_max = std::max(y_max, b.y_max);
+	}
+	bool intersects(const LodBox &b) const
+	{
+		return x_min <= b.x_max && b.x_min <= x_max && y_min <= b.y_max &&
+		       b.y_min <= y_max;
+	}
+	bool empty() const { return x_min > x_max; }
+};
+
+// Min/max pyramid over point indices of trajectory projection. Node i of
+// level l bounds points [i * leaf_size * 2^l, (i + 1) * leaf_size * 2^l],
+// including the first point of the next node, so it also bounds every
+// segment of its range. Rendering walks the pyramid down only where nodes
+// are visible and bigger than a pixel, so its cost depends on the view, not
+// on the trajectory length.
+class LodPyramid {
+	std::vector<std::vector<LodBox>> levels;
+	size_t points{0};
+
+	size_t node_size(size_t level) const { return leaf_size << level; }
+
+	template<typename Leaf, typename Coarse, typename Skip>
+	void visit(size_t level, size_t i, const LodBox &view, double x_res,
+	           double y_res, Leaf &leaf, Coarse &coarse, Skip &skip) const
+	{
+		if (i >= levels[level].size())
+			return;
+		auto &box = levels[level][i];
+		auto first = i * node_size(level);
+		auto last = std::min(first + node_size(level), points - 1);
+		if (!box.intersects(view)) {
+			skip(first, last);
+		}
+		else if (box.x_max - box.x_min <= x_res &&
+		         box.y_max - box.y_min <= y_res) {
+			coarse(first, last, box);
+		}
+		else if (!level) {
+			leaf(first, last);
+		}
+		else {
+			visit(level - 1, 2 * i, view, x_res, y_res, leaf, coarse, skip);
+			visit(level - 1, 2 * i + 1, view, x_res, y_res, leaf, coarse, skip);
+		}
+	}
+
+public:
+	static constexpr size_t leaf_size = 16;
+
+	LodPyramid() = default;
+	LodPyramid(const TrajectoryStorage &storage, int x_comp, int y_comp)
+	{
+		extend(storage, x_comp, y_comp);
+	}
+
+	// Adds points appended to storage since the last call. Only the nodes
+	// covering new points are recomputed.
+	void extend(const TrajectoryStorage &storage, int x_comp, int y_comp)
+	{
+		auto old_points = points;
+		points = storage.size();
+		if (points < 2)
+			return;
+		if (levels.empty())
+			levels.emplace_back();
+
+		// the last old leaf may miss points, it is rebuilt with the new ones
+		auto first = (old_points > 1) ? (old_points - 2) / leaf_size : 0uz;
+		auto &leaves = levels[0];
+		leaves.resize((points - 2) / leaf_size + 1);
+		std::fill(leaves.begin() + first, leaves.end(), LodBox{});
+
+		constexpr size_t chunk = leaf_size * 256;
+		std::vector<double> xs(chunk + 1), ys(chunk + 1);
+		for (auto k = first * leaf_size; k < points - 1; k += chunk) {
+			// one extra point to bound the segment joining the next node
+			auto n = std::min(chunk + 1, points - k);
+			storage.read(x_comp, k, n, xs.data());
+			storage.read(y_comp, k, n, ys.data());
+			for (auto j = 0uz; j < n; j++) {
+				auto idx = (k + j) / leaf_size;
+				if (idx < leaves.size())
+					leaves[idx].add(xs[j], ys[j]);
+				if ((k + j) % leaf_size == 0 && idx)
+					leaves[idx - 1].add(xs[j], ys[j]);
+			}
+		}
+
+		for (auto l = 1uz; levels[l - 1].size() > 1; l++) {
+			first /= 2;
+			if (levels.size() == l)
+				levels.emplace_back();
+			auto &lower = levels[l - 1];
+			auto &upper = levels[l];
+			upper.resize((lower.size() + 1) / 2);
+			std::fill(upper.begin() + first, upper.end(), LodBox{});
+			for (auto i = 2 * first; i < lower.size(); i++)
+				upper[i / 2].add(lower[i]);
+		}
+	}
+
+	// Upper bound of memory() for the given number of points
+	static size_t memory_estimate(size_t points)
+	{
+		// levels halve, so all of them together are twice the leaves
+		return 2 * 2 * (points / leaf_size + 1) * sizeof(LodBox);
+	}
+
+	size_t size() const { return points; }
+	LodBox bounds() const
+	{
+		return levels.empty() ? LodBox{} : levels.back()[0];
+	}
+	size_t memory() const
+	{
+		auto result = 0uz;
+		for (auto &l : levels)
+			result += l.capacity() * sizeof(LodBox);
+		return result;
+	}
+
+	// Walks index ranges in order. Ranges are passed to leaf if their points
+	// have to be drawn one by one, to coarse if they fit in x_res * y_res
+	// and to skip if they are out of view.
+	template<typename Leaf, typename Coarse, typename Skip>
+	void query(const LodBox &view, double x_res, double y_res, Leaf &&leaf,
+	           Coarse &&coarse, Skip &&skip) const
+	{
+		if (levels.empty())
+			return;
+		visit(levels.size() - 1, 0, view, x_res, y_res, leaf, coarse, skip);
+	}
+};
@@ -0,0 +1,185 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "solver.h"
+#include "trajectory_file.h"
+
+// Function of one argument given by samples (t, value) in a file, for
+// measured forcing terms. Binary trajectory files are memory mapped and read
+// in place, their first component is the value. CSV files have t and value
+// in the first two columns and may start with a header line.
+class LookupTable {
+	// mapped binary file
+	const char *data{nullptr};
+	size_t data_size{0};
+	BinaryHeader header;
+	// or samples read from CSV
+	std::vector<double> times;
+	std::vector<double> values;
+
+	size_t count{0};
+	bool uniform{false}; // times are evenly spaced from t0 by dt
+	double t0{};
+	double dt{};
+
+	double read(uint32_t column, size_t row) const noexcept
+	{
+		uint64_t bits;
+		std::memcpy(&bits, data + header.offset(column, row), sizeof(bits));
+		return std::bit_cast<double>(little_endian(bits));
+	}
+	double time(size_t i) const noexcept { return data ? read(0, i) : times[i]; }
+	double value(size_t i) const noexcept
+	{
+		return data ? read(1, i) : values[i];
+	}
+
+	void map_binary(const std::string &path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			throw std::runtime_error("Can't open " + path);
+		header = read_header(file);
+		if (header.columns < 2)
+			throw std::runtime_error(path + " has no values");
+		auto fd = ::open(path.c_str(), O_RDONLY);
+		struct stat info;
+		if (fd < 0 || fstat(fd, &info)) {
+			if (fd >= 0)
+				::close(fd);
+			throw std::runtime_error("Can't open " + path);
+		}
+		data_size = info.st_size;
+		auto expected = BinaryHeader::size + header.rows * header.columns * 8;
+		auto mapped = (data_size >= expected) ?
+		                mmap(nullptr, data_size, PROT_READ, MAP_PRIVATE, fd, 0) :
+		                MAP_FAILED;
+		::close(fd);
+		if (mapped == MAP_FAILED)
+			throw std::runtime_error("Can't map " + path);
+		data = static_cast<const char *>(mapped);
+		count = header.rows;
+	}
+
+	void read_csv(const std::string &path)
+	{
+		std::ifstream file(path);
+		if (!file)
+			throw std::runtime_error("Can't open " + path);
+		std::string line;
+		for (auto number = 1; std::getline(file, line); number++) {
+			auto comma = line.find(',');
+			auto end = line.find(',', comma + 1);
+			double t, v;
+			auto parsed = [&line](size_t first, size_t last, double &x) {
+				auto begin = line.data() + first;
+				auto stop = line.data() + std::min(last, line.size());
+				return std::from_chars(begin, stop, x).ec == std::errc{};
+			};
+			if (comma != std::string::npos && parsed(0, comma, t) &&
+			    parsed(comma + 1, end, v)) {
+				times.push_back(t);
+				values.push_back(v);
+			}
+			else if (number > 1 && !line.empty()) {
+				throw std::runtime_error(std::format("{}:{}: expected t,value",
+				                                     path, number));
+			}
+		}
+		count = times.size();
+	}
+
+	// Tangent of cubic interpolation at sample i
+	double tangent(size_t i) const noexcept
+	{
+		auto first = (i > 0) ? i - 1 : i;
+		auto last = (i + 1 < count) ? i + 1 : i;
+		return (value(last) - value(first)) / (time(last) - time(first));
+	}
+
+public:
+	explicit LookupTable(const std::string &path)
+	{
+		if (path.ends_with(".csv"))
+			read_csv(path);
+		else
+			map_binary(path);
+		if (!count)
+			throw std::runtime_error(path + " has no samples");
+		for (auto i = 1uz; i < count; i++)
+			if (!(time(i) > time(i - 1)))
+				throw std::runtime_error(path + ": t must grow");
+
+		// one division finds the interval on uniform grids
+		t0 = time(0);
+		dt = (count > 1) ? (time(count - 1) - t0) / (count - 1) : 0;
+		uniform = count > 1;
+		for (auto i = 1uz; i < count && uniform; i++)
+			uniform = std::abs(time(i) - (t0 + i * dt)) <= 1e-9 * std::abs(dt);
+	}
+	~LookupTable()
+	{
+		if (data)
+			munmap(const_cast<char *>(data), data_size);
+	}
+	LookupTable(const LookupTable &) = delete;
+	LookupTable &operator=(const LookupTable &) = delete;
+
+	size_t size() const { return count; }
+
+	// Interpolated value, the end values are kept outside of the samples.
+	// Cursor is the interval found last, so monotone arguments cost nothing
+	// to look up.
+	double operator()(double t, size_t &cursor, bool cubic) const noexcept
+	{
+		if (count == 1 || !(t > t0))
+			return value(0);
+		if (t >= time(count - 1))
+			return value(count - 1);
+
+		auto i = cursor;
+		auto inside = [this, t](size_t k) {
+			return k + 1 < count && time(k) <= t && t < time(k + 1);
+		};
+		if (uniform) {
+			i = std::min(size_t((t - t0) / dt), count - 2);
+			// rounding may put t into the neighbour interval
+			if (time(i) > t)
+				i--;
+			else if (time(i + 1) <= t)
+				i++;
+		}
+		else if (!inside(i) && !inside(++i)) {
+			// first sample after t
+			auto first = 0uz, last = count;
+			while (first < last) {
+				auto middle = first + (last - first) / 2;
+				if (time(middle) <= t)
+					first = middle + 1;
+				else
+					last = middle;
+			}
+			i = first - 1;
+		}
+		cursor = i;
+
+		auto ta = time(i), tb = time(i + 1);
+		auto va = value(i), vb = value(i + 1);
+		if (!cubic)
+			return va + (vb - va) * (t - ta) / (tb - ta);
+		return hermite(ta, va, tangent(i), tb, vb, tangent(i + 1), t);
+	}
+};
@@ -9,6 +9,7 @@
 int main(int argc, char *argv[])
 {
 	QApplication app(argc, argv);
+	app.setApplicationName("drawcpp");
 	MainWindow window(nullptr);
 	window.show();
 	return app.exec();
@@ -7,93 +7,191 @@
 #include <QDialogButtonBox>
 #include <QFileDialog>
 #include <QInputDialog>
-#include <QSplineSeries>
 #include <QValueAxis>
 #include <klfbackend.h>
 #include <QApplication>
 #include <QColorDialog>
-#include <QScreen>
+#include <QGraphicsScene>
 #include <QMessageBox>
+#include <QSlider>
+#include <cmath>
 #include <exception>
 #include <fstream>
+#include <optional>
 #include <print>
 #include "widgets.h"
 #include "picture_panel.h"
+#include "polyline_series.h"
+#include "latex_cache.h"
+#include "chart_export.h"
+#include "trace.h"
 
 using namespace std;
 using namespace QtCharts;
 
 void PicturePanel::add_chart(QString label,
-                             const QVector<QAbstractSeries *> &series)
+                             const QVector<QAbstractSeries *> &series,
+                             PictureTab *tab, bool keep_view)
 {
-	auto chart_view = new PictureTab(this);
-	chart_view->setRubberBand(QChartView::RubberBand::NoRubberBand);
-	chart_view->setRenderHint(QPainter::Antialiasing);
-	auto chart = chart_view->chart();
-	chart->legend()->setVisible(true);
-	auto x_axis = new QValueAxis();
-	x_axis->setLinePen(Qt::PenStyle::SolidLine);
-
-	auto y_axis = new QValueAxis;
-	y_axis->setLinePen(Qt::PenStyle::SolidLine);
-	for (auto &s : series)
-		chart->addSeries(s);
-
-	auto idx = tabs->addTab(chart_view, label);
-	tab2chart[idx] = chart_view;
-	chart->createDefaultAxes();
-	for (auto &axis : chart->axes()) {
-		if (draw_grid)
+	if (!tab) {
+		tab = new PictureTab(this);
+		tab->setRubberBand(QChartView::RubberBand::NoRubberBand);
+		tab->setRenderHint(QPainter::Antialiasing);
+		tab->chart()->legend()->setVisible(true);
+	}
+	tabs->addTab(tab, label);
+	tab->show_series(series, keep_view);
+}
+
+void PictureTab::show_series(const QVector<QAbstractSeries *> &series,
+                             bool keep_view)
+{
+	ScopedTimer timer("layout");
+	timer.add_items(series.size());
+	auto c = chart();
+	// values at the corners of the plot area, zoomed into again below
+	optional<QRectF> view;
+	if (keep_view && c->isZoomed() && !c->series().empty()) {
+		auto plot = c->plotArea();
+		view = QRectF(c->mapToValue(plot.topLeft()),
+		              c->mapToValue(plot.bottomRight()));
+	}
+	c->removeAllSeries();
+	for (auto axis : c->axes()) {
+		c->removeAxis(axis);
+		delete axis;
+	}
+	c->zoomReset();
+	populate_chart(c, series);
+	if (view && !series.empty())
+		c->zoomIn(QRectF(c->mapToPosition(view->topLeft()),
+		                 c->mapToPosition(view->bottomRight()))
+		            .normalized());
+	for (auto &axis : c->axes()) {
+		if (owner->draw_grid)
 			((QValueAxis *)axis)->applyNiceNumbers();
 		else
 			((QValueAxis *)axis)->setTickCount(2);
 	}
+	text_idx = -1;
+	index_dirty = true;
+	chart_dirty = true;
 }
 
 PictureTab::PictureTab(PicturePanel *o): QtCharts::QChartView(o), owner(o)
 {
 	setMouseTracking(true);
 	setMinimumSize(500, 500);
-	bool ok = KLFBackend::detectSettings(&settings);
-	if (!ok) {
-		// vital program not found
-		throw(std::runtime_error("error in your system: are latex,dvips and gs "
-		                         "installed?"));
-	}
 
-	input.mathmode = "\\begin{equation*} ... \\end{equation*}";
-	input.preamble = "\\usepackage{amsmath}\n";
-	input.dpi = 300;
+	// Any change of series, axes or layout changes the scene
+	connect(scene(), &QGraphicsScene::changed, this,
+	        [this]() { chart_dirty = true; });
+
+	input = latex_input();
 }
 
 PicturePanel::PicturePanel(MainWindow *parent): mw(parent), draw_grid{false}
 {
 	tabs = new QTabWidget(this);
+	sliders = new ParameterSliders(this);
 	auto layout = new QHBoxLayout(this);
 	layout->addWidget(tabs);
+	layout->addWidget(sliders);
 	add_chart("", {});
 
 	chart_dialog = new ChartDialog(this);
 }
 
-void PictureTab::paintEvent(QPaintEvent *e)
+ParameterSliders::ParameterSliders(PicturePanel *o): QWidget(o), owner(o)
 {
-	if (making_cache || !mouse_pressed) {
-		QChartView::paintEvent(e);
-		if (making_cache) {
-			making_cache = false;
-			return;
-		}
-	}
+	layout = new QFormLayout(this);
+	refine = new QTimer(this);
+	refine->setSingleShot(true);
+	refine->setInterval(300);
+	connect(refine, &QTimer::timeout, this, [this]() { owner->refresh(false); });
+	setMinimumWidth(250);
+	hide();
+}
 
-	QPainter painter(viewport());
-	if (mouse_pressed) {
-		painter.drawPixmap(0, 0, cached_graph);
+void ParameterSliders::rebuild(const QVector<ChartDialog::Parameter> &params)
+{
+	refine->stop();
+	while (layout->rowCount())
+		layout->removeRow(0);
+	// names are told apart by charts if several of them have parameters
+	auto several = any_of(params.begin(), params.end(), [&params](auto &p) {
+		return p.chart != params.front().chart;
+	});
+
+	for (auto &p : params) {
+		// the range is centered at the value, so it can change sign
+		auto half = max(abs(p.value), 1.);
+		auto from = p.value - half;
+		auto slider = new QSlider(Qt::Horizontal);
+		slider->setRange(0, resolution);
+		slider->setValue(resolution / 2);
+		auto value_label = new QLabel(QString::number(p.value, 'g', 4));
+		value_label->setMinimumWidth(60);
+		auto row = new QHBoxLayout;
+		row->addWidget(slider);
+		row->addWidget(value_label);
+		layout->addRow(several ? p.name + " (" + p.chart + ")" : p.name, row);
+
+		connect(slider, &QSlider::valueChanged, this,
+		        [this, tab = p.tab, name = p.name, from, half,
+		         value_label](int pos) {
+			        if (!tab)
+				        return;
+			        auto v = from + 2 * half * pos / resolution;
+			        value_label->setText(QString::number(v, 'g', 4));
+			        tab->set_parameter(name, v);
+			        owner->refresh(true);
+			        refine->start();
+		        });
 	}
+	setVisible(!params.empty());
+}
 
-	for (auto &text : texts) {
-		auto coords = chart2widget({text.coords});
-		painter.drawPixmap(coords.x(), coords.y(), text.pm);
+void PictureTab::render_chart_layer()
+{
+	ScopedTimer timer("chart");
+	auto ratio = devicePixelRatioF();
+	chart_layer = QPixmap(viewport()->size() * ratio);
+	chart_layer.setDevicePixelRatio(ratio);
+	chart_layer.fill(Qt::transparent);
+	QPainter painter(&chart_layer);
+	painter.setRenderHints(renderHints());
+	render(&painter, QRectF(), viewport()->rect());
+	chart_dirty = false;
+}
+
+void PictureTab::paintEvent(QPaintEvent *e)
+{
+	ScopedTimer timer("paint");
+	if (chart_dirty || chart_layer.isNull())
+		render_chart_layer();
+
+	QPainter painter(viewport());
+	auto dirty = e->rect();
+	auto ratio = chart_layer.devicePixelRatioF();
+	painter.drawPixmap(dirty, chart_layer,
+	                   QRectF(QPointF(dirty.topLeft()) * ratio,
+	                          QSizeF(dirty.size()) * ratio));
+
+	// labels added later are drawn on top
+	auto visible = texts_near(dirty);
+	sort(visible.begin(), visible.end());
+	for (auto i : visible) {
+		auto rect = text_rect(i);
+		if (!rect.intersects(dirty))
+			continue;
+		if (!texts[i].pm.isNull()) {
+			painter.drawPixmap(rect.topLeft(), texts[i].pm);
+			continue;
+		}
+		painter.setPen(Qt::PenStyle::DotLine);
+		painter.drawRect(rect);
+		painter.drawText(rect, Qt::AlignCenter, "TeX...");
 	}
 
 	if (mouse_pressed && owner->zoom_mode) {
@@ -102,6 +200,12 @@ void PictureTab::paintEvent(QPaintEvent *e)
 	}
 }
 
+void PictureTab::resizeEvent(QResizeEvent *e)
+{
+	chart_dirty = true;
+	QChartView::resizeEvent(e);
+}
+
 void PictureTab::mousePressEvent(QMouseEvent *e)
 {
 	if (e->button() != Qt::LeftButton)
@@ -110,31 +214,55 @@ void PictureTab::mousePressEvent(QMouseEvent *e)
 	mouse_pressed = true;
 
 	if (owner->zoom_mode) {
-		auto screen = QApplication::primaryScreen();
-		cached_graph = screen->grabWindow(winId());
 		zoom_start = e->pos();
+		zoom_end = zoom_start;
 	}
 	else {
 		find_text(e->pos());
-		if (text_idx != -1) {
-			making_cache = true;
-			cached_graph = grab();
-		}
 	}
 }
 
-void PictureTab::find_text(QPoint pos)
+void PictureTab::rebuild_index()
 {
-	for (auto i = 0; i < texts.size(); i++) {
-		auto coords = chart2widget({texts[i].coords});
-		auto text_rect = QRect(coords, texts[i].pm.size());
-		if (text_rect.contains(pos)) {
-			text_idx = i;
-			mouse_text_offset = pos - text_rect.topLeft();
-			return;
-		}
+	QVector<QPointF> anchors;
+	max_text_size = placeholder_size;
+	for (auto &text : texts) {
+		anchors.append(text.coords);
+		max_text_size = max_text_size.expandedTo(text.size());
 	}
+	auto plot = chart()->plotArea().toRect();
+	auto range = QRectF(widget2chart(plot.topLeft()),
+	                    widget2chart(plot.bottomRight()));
+	text_index.rebuild(anchors, range.normalized());
+	index_dirty = false;
+}
+
+QRect PictureTab::text_rect(int idx)
+{
+	return QRect(chart2widget(texts[idx].coords), texts[idx].size());
+}
+
+QVector<int> PictureTab::texts_near(const QRect &rect)
+{
+	if (index_dirty)
+		rebuild_index();
+	// anchor is the top left corner of the label
+	auto anchors = rect.adjusted(-max_text_size.width(),
+	                             -max_text_size.height(), 0, 0);
+	auto area = QRectF(widget2chart(anchors.topLeft()),
+	                   widget2chart(anchors.bottomRight()));
+	return text_index.find(area.normalized());
+}
+
+void PictureTab::find_text(QPoint pos)
+{
+	// topmost label is the one added last
 	text_idx = -1;
+	for (auto i : texts_near(QRect(pos, QSize(1, 1))))
+		if (i > text_idx && text_rect(i).contains(pos))
+			text_idx = i;
+	if (text_idx != -1)
+		mouse_text_offset = pos - text_rect(text_idx).topLeft();
 }
 
 void PictureTab::mouseDoubleClickEvent(QMouseEvent *e)
@@ -150,19 +278,41 @@ void PictureTab::mouseDoubleClickEvent(QMouseEvent *e)
 		viewport()->update();
 }
 
-QPixmap PictureTab::process_latex()
+void PictureTab::request_latex(int idx)
 {
-	input.latex = texts[text_idx].text;
-	input.fontsize = texts[text_idx].font;
-	auto out = KLFBackend::getLatexFormula(input, settings);
-	auto pm = QPixmap::fromImage(out.result);
-	pm.setMask(pm.createMaskFromColor("white"));
-	return pm;
+	input.latex = texts[idx].text;
+	input.fontsize = texts[idx].font;
+	auto key = LatexCache::key(input);
+	texts[idx].key = key;
+
+	auto cached = LatexCache::instance().find(key);
+	if (!cached.isNull()) {
+		texts[idx].pm = latex_pixmap(cached);
+		return;
+	}
+
+	texts[idx].pm = {};
+	render_latex_async(input, this, [this, key](QImage image) {
+		static bool warned = false;
+		if (image.isNull() && !latex_settings() && !warned) {
+			warned = true;
+			QMessageBox::warning(this, "Error",
+			                     "Labels can't be rendered: are latex, dvips "
+			                     "and gs installed?");
+		}
+		auto pm = latex_pixmap(image);
+		for (auto &text : texts)
+			if (text.key == key)
+				text.pm = pm;
+		max_text_size = max_text_size.expandedTo(pm.size());
+		viewport()->update();
+	});
 }
 
 void PicturePanel::open_project(QString fileName)
 {
-	tab2chart.clear();
+	for (auto i = 0; i < tabs->count(); i++)
+		((PictureTab *)tabs->widget(i))->texts.clear();
 	try {
 		ifstream ifs(fileName.toStdString());
 		nlohmann::json info;
@@ -171,11 +321,20 @@ void PicturePanel::open_project(QString fileName)
 		chart_dialog->import(info);
 		graph_dialog();
 		mw->setWindowTitle(mw->windowTitle().chopped(3));
-		// TODO
-		// for (auto &latex : info["latex"]) {
-		//  content()->texts.push_back(latex);
-		//  content()->texts[text_idx++].pm = process_latex();
-		//}
+		if (!info.contains("latex"))
+			return;
+		// labels are rendered concurrently, placeholders are shown meanwhile
+		for (auto i = 0; i < tabs->count(); i++) {
+			auto label = tabs->tabText(i).toStdString();
+			if (!info["latex"].contains(label))
+				continue;
+			auto tab = (PictureTab *)tabs->widget(i);
+			for (auto &latex : info["latex"][label]) {
+				tab->texts.push_back(latex);
+				tab->request_latex(tab->texts.size() - 1);
+			}
+			tab->index_dirty = true;
+		}
 	}
 	catch (std::exception &e) {
 		QMessageBox::warning(this, "Import Error", e.what());
@@ -188,9 +347,11 @@ void PicturePanel::save_project(QString filename)
 	ofstream ofs(filename.toStdString());
 	auto js = nlohmann::json(*chart_dialog);
 
-	// TODO
-	// for (auto text : content()->texts)
-	// js["latex"].push_back(text);
+	for (auto i = 0; i < tabs->count(); i++) {
+		auto tab = (PictureTab *)tabs->widget(i);
+		for (auto &text : tab->texts)
+			js["latex"][tabs->tabText(i).toStdString()].push_back(text);
+	}
 
 	ofs << setw(4) << js;
 }
@@ -207,12 +368,43 @@ void PicturePanel::graph_dialog()
 	if (!elems.size())
 		return;
 	mark_unsaved();
+	show_elements(elems, false);
+	sliders->rebuild(chart_dialog->parameters());
+}
+
+void PicturePanel::refresh(bool preview)
+{
+	auto elems = chart_dialog->elements(preview);
+	if (!elems.size())
+		return;
+	mark_unsaved();
+	show_elements(elems, true);
+}
+
+void PicturePanel::show_elements(const SeriesInfo &elems, bool keep_view)
+{
+	// tabs are reused, the ones with the same label keep their texts
+	QMap<QString, PictureTab *> old;
 	while (tabs->count()) {
-		tabs->widget(0)->deleteLater();
+		old[tabs->tabText(0)] = (PictureTab *)tabs->widget(0);
 		tabs->removeTab(0);
 	}
+	QVector<PictureTab *> spare;
+	for (auto tab : old)
+		spare.append(tab);
 	for (auto &[label, series] : elems)
-		add_chart(label, series);
+		if (old.contains(label))
+			spare.removeOne(old[label]);
+	for (auto &[label, series] : elems) {
+		auto tab = old.value(label);
+		if (!tab && !spare.empty()) {
+			tab = spare.takeLast();
+			tab->texts.clear();
+		}
+		add_chart(label, series, tab, keep_view);
+	}
+	for (auto tab : spare)
+		tab->deleteLater();
 }
 
 bool PictureTab::input_latex(QPointF location)
@@ -241,6 +433,7 @@ bool PictureTab::input_latex(QPointF location)
 		buttonBox.addButton(delete_button, QDialogButtonBox::ActionRole);
 		connect(delete_button, &QPushButton::released, this, [this, &buttonBox]() {
 			texts.removeAt(text_idx);
+			index_dirty = true;
 			buttonBox.rejected();
 		});
 	}
@@ -258,7 +451,8 @@ bool PictureTab::input_latex(QPointF location)
 		texts[text_idx].text = lineEdit->text();
 		texts[text_idx].font = doubleEdit->value();
 		texts[text_idx].coords = location;
-		texts[text_idx].pm = process_latex();
+		request_latex(text_idx);
+		index_dirty = true;
 		owner->mark_unsaved();
 		return true;
 	}
@@ -289,14 +483,38 @@ void PictureTab::mouseMoveEvent(QMouseEvent *e)
 	if (!mouse_pressed)
 		return;
 
-	if (owner->zoom_mode)
+	// only the union of old and new rectangles is repainted
+	QRect dirty;
+	if (owner->zoom_mode) {
+		dirty = QRect(zoom_start, zoom_end).normalized();
 		zoom_end = e->pos();
-	else if (text_idx != -1)
+		dirty |= QRect(zoom_start, zoom_end).normalized();
+	}
+	else if (text_idx != -1) {
+		dirty = text_rect(text_idx);
+		auto from = texts[text_idx].coords;
 		texts[text_idx].coords = widget2chart(e->pos() - mouse_text_offset);
-	else
+		if (!index_dirty)
+			text_index.move(text_idx, from, texts[text_idx].coords);
+		dirty |= text_rect(text_idx);
+	}
+	else {
 		return;
+	}
 
-	viewport()->update();
+	viewport()->update(dirty.adjusted(-2, -2, 2, 2));
+}
+
+bool PicturePanel::export_chart(const QString &filename)
+{
+	auto tab = (PictureTab *)tabs->currentWidget();
+	if (!tab)
+		return false;
+	return ::export_chart(*tab, filename, [tab](QPainter &painter) {
+		for (auto i = 0; i < tab->texts.size(); i++)
+			if (!tab->texts[i].pm.isNull())
+				painter.drawPixmap(tab->text_rect(i).topLeft(), tab->texts[i].pm);
+	});
 }
 
 void PicturePanel::zoomReset()
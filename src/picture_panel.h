@@ -2,18 +2,26 @@
 #include <QString>
 #include <QPixmap>
 #include <QChartView>
+#include <QTimer>
 #include <chart_dialog.h>
 #include <klfbackend.h>
+#include "text_index.h"
 
 class MainWindow;
 class PictureTab;
+class ParameterSliders;
 constexpr double default_font = 7;
+// Drawn instead of latex text while it is being rendered
+constexpr QSize placeholder_size{60, 20};
 
 struct Text {
 	QPointF coords;
 	QPixmap pm;
 	QString text;
 	double font{default_font};
+	QByteArray key; // of the last requested rendering
+
+	QSize size() const { return pm.isNull() ? placeholder_size : pm.size(); }
 
 	operator nlohmann::json() const
 	{
@@ -36,26 +44,37 @@ struct Text {
 class PicturePanel : public QWidget {
 	MainWindow *mw;
 	QTabWidget *tabs;
-	QMap<int, PictureTab *> tab2chart;
 
 	bool zoom_mode{false};
 
 	bool draw_grid; // TODO maybe checkmark in dialog
 
 	ChartDialog *chart_dialog;
+	ParameterSliders *sliders;
 
 	void draw_new_equations();
 
 	void mark_unsaved();
+	// Tab is reused if given, otherwise a new one is made
 	void add_chart(QString label,
-	               const QVector<QtCharts::QAbstractSeries *> &series);
+	               const QVector<QtCharts::QAbstractSeries *> &series,
+	               PictureTab *tab = nullptr, bool keep_view = false);
+	// Tabs with the same labels get the new series
+	void show_elements(const SeriesInfo &elems, bool keep_view);
 
 public:
 	PicturePanel(MainWindow *);
 	bool switch_zoom() { return zoom_mode = !zoom_mode; }
 	void graph_dialog();
+	// Draws charts again after a change of parameters, zoom is kept
+	void refresh(bool preview);
 	void open_project(QString filename);
 	void save_project(QString filename);
+	// Current chart with its labels as svg or pdf
+	bool export_chart(const QString &filename);
+	// Taken by solutions of the charts and their pyramids
+	size_t memory() const { return chart_dialog->memory(); }
+	size_t memory_budget() const { return chart_dialog->budget(); }
 	void zoomReset();
 	friend class PictureTab;
 };
@@ -64,12 +83,10 @@ class PictureTab : public QtCharts::QChartView {
 private:
 	PicturePanel *owner;
 
-	bool making_cache{false};
-
 	// For latex processing
-	KLFBackend::klfSettings settings;
 	KLFBackend::klfInput input;
-	QPixmap process_latex();
+	// Text gets its pixmap when rendering finishes, placeholder is drawn before
+	void request_latex(int idx);
 	bool input_latex(QPointF location);
 	QVector<Text> texts;
 	int text_idx{-1};         // index of text under mouse cursor
@@ -80,11 +97,27 @@ private:
 	QPoint zoom_start;
 	QPoint zoom_end;
 
-	QPixmap cached_graph;
+	// Chart rendered offscreen. Latex texts and zoom rectangle are drawn on
+	// top of it, so moving them doesn't render the chart again.
+	QPixmap chart_layer;
+	bool chart_dirty{true};
+	void render_chart_layer();
+
+	// Labels are looked up by anchors in chart coordinates
+	TextIndex text_index;
+	bool index_dirty{true};
+	QSize max_text_size{placeholder_size};
+	void rebuild_index();
+	QRect text_rect(int idx);
+	QVector<int> texts_near(const QRect &rect); // may intersect rect
 
 	QPoint chart2widget(QPointF coord);
 	QPointF widget2chart(QPoint coord);
 	void find_text(QPoint pos); // check if there's latex text under mouse
+	// Replaces series of the chart, labels are kept. Zoomed view is kept too
+	// if asked, otherwise axes are fitted to the series.
+	void show_series(const QVector<QtCharts::QAbstractSeries *> &series,
+	                 bool keep_view = false);
 
 protected:
 	void mouseMoveEvent(QMouseEvent *e) override;
@@ -92,7 +125,25 @@ protected:
 	void mouseReleaseEvent(QMouseEvent *e) override;
 	void mouseDoubleClickEvent(QMouseEvent *e) override;
 	void paintEvent(QPaintEvent *) override;
+	void resizeEvent(QResizeEvent *e) override;
 
 public:
 	PictureTab(PicturePanel *o);
+	friend class PicturePanel;
+};
+
+// Slider per parameter of the charts. Moving one solves the charts coarsely
+// at once and in full when the slider rests.
+class ParameterSliders : public QWidget {
+	PicturePanel *owner;
+	QFormLayout *layout;
+	QTimer *refine; // restarted by every move
+
+	// Slider positions over the range
+	static constexpr int resolution = 1000;
+
+public:
+	ParameterSliders(PicturePanel *o);
+	// Sliders are centered at the current values
+	void rebuild(const QVector<ChartDialog::Parameter> &parameters);
 };
@@ -0,0 +1,345 @@
+#include <QPainter>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include "polyline_series.h"
+#include "solver.h"
+
+using namespace std;
+using namespace QtCharts;
+
+// Storage is decoded by chunks, so compressed form is never expanded
+constexpr size_t read_chunk = 4096;
+// Points per drawPolyline call
+constexpr int polyline_batch = 2048;
+// Douglas-Peucker tolerance in device pixels
+constexpr double simplify_tolerance = 0.25;
+// Steps longer than this many device pixels are drawn by dense output,
+// split into at most max_pieces
+constexpr double dense_step = 4;
+constexpr int max_pieces = 64;
+
+PolylineSeries::PolylineSeries(shared_ptr<const TrajectoryStorage> s, int x,
+                               int y, shared_ptr<LodPyramid> p)
+  : storage(std::move(s)), x_comp(x), y_comp(y), pyramid(std::move(p))
+{
+	if (!pyramid)
+		pyramid = make_shared<LodPyramid>();
+	grow();
+}
+
+PolylineSeries::~PolylineSeries()
+{
+	delete item;
+}
+
+void PolylineSeries::grow()
+{
+	pyramid->extend(*storage, x_comp, y_comp);
+	if (storage->size() == 1)
+		bounds =
+		  QRectF(storage->value(x_comp, 0), storage->value(y_comp, 0), 0, 0);
+	auto box = pyramid->bounds();
+	if (!box.empty())
+		bounds =
+		  QRectF(QPointF(box.x_min, box.y_min), QPointF(box.x_max, box.y_max));
+	if (!item)
+		return;
+	refit_axes(chart());
+	item->update();
+}
+
+ProjectionItem *PolylineSeries::make_item(QChart *chart)
+{
+	return new PolylineItem(chart, this);
+}
+
+void PolylineSeries::attach(QChart *chart)
+{
+	item = make_item(chart);
+	auto repaint = [this]() { item->update(); };
+	for (auto axis : attachedAxes())
+		connect(axis, &QAbstractAxis::rangeChanged, this, repaint);
+	connect(this, &QAbstractSeries::visibleChanged, this, repaint);
+	connect(chart, &QChart::plotAreaChanged, this,
+	        [this]() { item->plot_area_changed(); });
+}
+
+namespace {
+
+struct Sample {
+	double t;
+	double x;
+	double y;
+};
+
+// Reads storage by windows, so sequential access decodes every compressed
+// block once
+class WindowReader {
+	const TrajectoryStorage &storage;
+	int x_comp;
+	int y_comp;
+	size_t start{0};
+	size_t count{0};
+	vector<double> ts;
+	vector<double> xs;
+	vector<double> ys;
+
+public:
+	WindowReader(const TrajectoryStorage &s, int x, int y)
+	  : storage(s), x_comp(x), y_comp(y), ts(read_chunk), xs(read_chunk),
+	    ys(read_chunk)
+	{
+	}
+	Sample operator()(size_t k)
+	{
+		if (k < start || k >= start + count) {
+			start = k;
+			count = min(read_chunk, storage.size() - k);
+			storage.read(-1, start, count, ts.data());
+			storage.read(x_comp, start, count, xs.data());
+			storage.read(y_comp, start, count, ys.data());
+		}
+		return {ts[k - start], xs[k - start], ys[k - start]};
+	}
+};
+
+// Douglas-Peucker simplification keeping points deviating from the chord
+// by more than tolerance. Ends are always kept, so batches stay joined.
+void simplify(const QVector<QPointF> &points, double tolerance,
+              QVector<QPointF> &out)
+{
+	out.clear();
+	if (points.size() < 3) {
+		out = points;
+		return;
+	}
+	vector<bool> keep(points.size());
+	keep.front() = keep.back() = true;
+	vector<pair<int, int>> ranges{{0, int(points.size()) - 1}};
+	while (!ranges.empty()) {
+		auto [first, last] = ranges.back();
+		ranges.pop_back();
+		auto a = points[first], b = points[last];
+		auto chord = b - a;
+		auto length = hypot(chord.x(), chord.y());
+		auto max_dist = 0.;
+		auto idx = first;
+		for (auto i = first + 1; i < last; i++) {
+			auto d = points[i] - a;
+			auto dist = (length > 0) ?
+			              abs(chord.x() * d.y() - chord.y() * d.x()) / length :
+			              hypot(d.x(), d.y());
+			if (dist > max_dist) {
+				max_dist = dist;
+				idx = i;
+			}
+		}
+		if (max_dist <= tolerance)
+			continue;
+		keep[idx] = true;
+		ranges.push_back({first, idx});
+		ranges.push_back({idx, last});
+	}
+	for (auto i = 0; i < points.size(); i++)
+		if (keep[i])
+			out.append(points[i]);
+}
+
+} // namespace
+
+ProjectionItem::ProjectionItem(QChart *c, PolylineSeries *s)
+  : QGraphicsItem(c), chart(c), series(s)
+{
+	setZValue(4); // the one Qt uses for its series, below the legend
+}
+
+pair<QValueAxis *, QValueAxis *> ProjectionItem::axes() const
+{
+	QValueAxis *x_axis = nullptr, *y_axis = nullptr;
+	for (auto axis : series->attachedAxes()) {
+		auto value_axis = qobject_cast<QValueAxis *>(axis);
+		if (axis->orientation() == Qt::Horizontal)
+			x_axis = value_axis;
+		else
+			y_axis = value_axis;
+	}
+	return {x_axis, y_axis};
+}
+
+double device_resolution(const QPainter *painter)
+{
+	auto device = painter->deviceTransform();
+	return max(hypot(device.m11(), device.m12()), 1e-9);
+}
+
+void PolylineItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *,
+                         QWidget *)
+{
+	auto [x_axis, y_axis] = axes();
+	if (!series->isVisible() || !x_axis || !y_axis)
+		return;
+
+	auto pixel = 1 / device_resolution(painter);
+
+	auto plot = chart->plotArea();
+	auto x_scale = plot.width() / (x_axis->max() - x_axis->min());
+	auto y_scale = plot.height() / (y_axis->max() - y_axis->min());
+	auto map = [&](double x, double y) {
+		return QPointF(plot.left() + (x - x_axis->min()) * x_scale,
+		               plot.bottom() - (y - y_axis->min()) * y_scale);
+	};
+	// points closer than half a pixel to the previous one add nothing
+	auto same_pixel = [pixel](const QPointF &a, const QPointF &b) {
+		return abs(a.x() - b.x()) < pixel / 2 && abs(a.y() - b.y()) < pixel / 2;
+	};
+
+	painter->save();
+	painter->setClipRect(plot);
+	painter->setPen(series->pen());
+	painter->setBrush(Qt::NoBrush);
+
+	QVector<QPointF> batch, simplified;
+	batch.reserve(polyline_batch);
+	auto flush = [&, painter]() {
+		if (batch.size() > 1) {
+			simplify(batch, simplify_tolerance * pixel, simplified);
+			painter->drawPolyline(simplified.data(), simplified.size());
+		}
+		batch.clear();
+	};
+	auto append = [&](const QPointF &point) {
+		if (!batch.empty() && same_pixel(batch.back(), point))
+			return;
+		batch.append(point);
+		if (batch.size() >= polyline_batch) {
+			flush();
+			batch.append(point);
+		}
+	};
+
+	// view is one pixel wider to keep lines crossing plot borders
+	auto x_res = pixel / x_scale, y_res = pixel / y_scale;
+	LodBox view;
+	view.add(x_axis->min() - x_res, y_axis->min() - y_res);
+	view.add(x_axis->max() + x_res, y_axis->max() + y_res);
+
+	WindowReader reader(*series->storage, series->x_comp, series->y_comp);
+	auto size = series->storage->size();
+	// Zoomed in steps are interpolated, so the curve stays smooth whatever
+	// the integration step is
+	auto dense = [&](size_t k) {
+		auto a = reader(k - 1), b = reader(k);
+		auto from = map(a.x, a.y), to = map(b.x, b.y);
+		auto length = hypot(to.x() - from.x(), to.y() - from.y());
+		auto pieces = min(max_pieces, int(length / (dense_step * pixel)));
+		if (pieces < 2 || !(b.t > a.t))
+			return;
+		auto next = (k + 1 < size) ? reader(k + 1) : b;
+		auto dx0 = (b.x - a.x) / (b.t - a.t), dy0 = (b.y - a.y) / (b.t - a.t);
+		auto dx1 = dx0, dy1 = dy0;
+		if (next.t > b.t) {
+			dx1 = (next.x - b.x) / (next.t - b.t);
+			dy1 = (next.y - b.y) / (next.t - b.t);
+		}
+		for (auto i = 1; i < pieces; i++) {
+			auto t = a.t + (b.t - a.t) * i / pieces;
+			append(map(hermite(a.t, a.x, dx0, b.t, b.x, dx1, t),
+			           hermite(a.t, a.y, dy0, b.t, b.y, dy1, t)));
+		}
+	};
+	optional<size_t> last_point; // the stored point appended last
+	auto leaf = [&](size_t first, size_t last) {
+		for (auto k = first; k <= last; k++) {
+			if (k && last_point == k - 1)
+				dense(k);
+			auto sample = reader(k);
+			append(map(sample.x, sample.y));
+			last_point = k;
+		}
+	};
+	// whole range is inside one pixel
+	auto coarse = [&](size_t, size_t, const LodBox &box) {
+		append(map((box.x_min + box.x_max) / 2, (box.y_min + box.y_max) / 2));
+		last_point.reset();
+	};
+	auto skip = [&](size_t, size_t) {
+		flush();
+		last_point.reset();
+	};
+	series->pyramid->query(view, x_res, y_res, leaf, coarse, skip);
+	flush();
+	painter->restore();
+}
+
+void fit_axes(QChart *chart)
+{
+	auto inf = numeric_limits<double>::infinity();
+	double x_min = inf, x_max = -inf, y_min = inf, y_max = -inf;
+	auto unite = [&](const QPointF &p) {
+		x_min = min(x_min, p.x());
+		x_max = max(x_max, p.x());
+		y_min = min(y_min, p.y());
+		y_max = max(y_max, p.y());
+	};
+	for (auto s : chart->series()) {
+		if (auto polyline = dynamic_cast<PolylineSeries *>(s)) {
+			if (polyline->storage->size()) {
+				unite(polyline->bounds.topLeft());
+				unite(polyline->bounds.bottomRight());
+			}
+		}
+		else if (auto xy = qobject_cast<QXYSeries *>(s)) {
+			for (auto &p : xy->pointsVector())
+				unite(p);
+		}
+	}
+	if (x_min > x_max)
+		return;
+
+	// degenerate ranges are widened to keep axes valid
+	auto widen = [](double &low, double &high) {
+		if (low == high) {
+			low -= 0.5;
+			high += 0.5;
+		}
+	};
+	widen(x_min, x_max);
+	widen(y_min, y_max);
+	for (auto axis : chart->axes(Qt::Horizontal))
+		axis->setRange(x_min, x_max);
+	for (auto axis : chart->axes(Qt::Vertical))
+		axis->setRange(y_min, y_max);
+}
+
+void refit_axes(QChart *chart)
+{
+	if (chart && !chart->isZoomed())
+		fit_axes(chart);
+}
+
+void populate_chart(QChart *chart, const QVector<QAbstractSeries *> &series)
+{
+	for (auto &s : series)
+		chart->addSeries(s);
+	chart->createDefaultAxes();
+	fit_axes(chart);
+	for (auto &s : series)
+		if (auto polyline = dynamic_cast<PolylineSeries *>(s))
+			polyline->attach(chart);
+}
+
+QScatterSeries *scatter_series(const QColor &color)
+{
+	auto scatter = new QScatterSeries();
+	scatter->setMarkerSize(4);
+	scatter->setColor(color);
+	scatter->setBorderColor(color);
+	return scatter;
+}
+
+QString comp_name(int comp)
+{
+	return (comp == -1) ? "t" : "x_" + QString::number(comp);
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <QLineSeries>
+#include <QScatterSeries>
+#include <QValueAxis>
+#include <QChart>
+#include <QGraphicsItem>
+#include <memory>
+#include "lod_pyramid.h"
+
+class ProjectionItem;
+
+// Projection of a stored trajectory onto two components. The series itself
+// stays empty, so Qt only uses it for legend and axes, while the points are
+// drawn straight from the storage by PolylineItem.
+class PolylineSeries : public QtCharts::QLineSeries {
+protected:
+	std::shared_ptr<const TrajectoryStorage> storage;
+	int x_comp;
+	int y_comp;
+	std::shared_ptr<LodPyramid> pyramid; // may be shared with earlier series
+	QRectF bounds; // data range of the projection
+	ProjectionItem *item{nullptr};
+
+	virtual ProjectionItem *make_item(QtCharts::QChart *chart);
+
+	friend class PolylineItem;
+	friend class DensityItem;
+	friend void fit_axes(QtCharts::QChart *chart);
+
+public:
+	// Pyramid of the same projection of s is taken as is and extended, so
+	// series is rebuilt without going over the whole storage
+	PolylineSeries(std::shared_ptr<const TrajectoryStorage> s, int x, int y,
+	               std::shared_ptr<LodPyramid> p = {});
+	// Series may be removed from a chart which is kept
+	~PolylineSeries() override;
+	// Must be called after the series is added to chart and axes are attached
+	void attach(QtCharts::QChart *chart);
+	// Takes points appended to the storage since the last call
+	void grow();
+};
+
+// Draws series over the plot area of chart
+class ProjectionItem : public QGraphicsItem {
+protected:
+	QtCharts::QChart *chart;
+	PolylineSeries *series;
+
+	// Null if series has no value axes
+	std::pair<QtCharts::QValueAxis *, QtCharts::QValueAxis *> axes() const;
+
+public:
+	ProjectionItem(QtCharts::QChart *c, PolylineSeries *s);
+	void plot_area_changed()
+	{
+		prepareGeometryChange();
+		update();
+	}
+	QRectF boundingRect() const override { return chart->plotArea(); }
+};
+
+class PolylineItem : public ProjectionItem {
+public:
+	using ProjectionItem::ProjectionItem;
+	void paint(QPainter *painter, const QStyleOptionGraphicsItem *,
+	           QWidget *) override;
+};
+
+// Device pixels per item unit, exports may paint at finer resolution than
+// the screen
+double device_resolution(const QPainter *painter);
+
+// Sets axes ranges of the chart to cover all xy series including polylines
+void fit_axes(QtCharts::QChart *chart);
+// Follows growing series unless user has zoomed the chart
+void refit_axes(QtCharts::QChart *chart);
+
+// Adds series to chart with axes fitted to them
+void populate_chart(QtCharts::QChart *chart,
+                    const QVector<QtCharts::QAbstractSeries *> &series);
+QtCharts::QScatterSeries *scatter_series(const QColor &color);
+// Label of ComponentChoice index
+QString comp_name(int comp);
@@ -0,0 +1,363 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <map>
+#include <numbers>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+#include "formula_processor.h"
+#include "solver.h"
+
+// Counter based generator Philox4x32-10 (Salmon et al., "Parallel random
+// numbers: as easy as 1, 2, 3"). Numbers are a function of the key and the
+// counter, so every path and step has its own stream without any state.
+class Philox {
+	std::array<std::uint32_t, 2> key;
+
+public:
+	using Block = std::array<std::uint32_t, 4>;
+
+	explicit Philox(std::uint64_t seed)
+	  : key{std::uint32_t(seed), std::uint32_t(seed >> 32)}
+	{
+	}
+
+	Block operator()(Block counter) const
+	{
+		auto k = key;
+		for (auto round = 0; round < 10; round++) {
+			auto p0 = std::uint64_t(0xD2511F53) * counter[0];
+			auto p1 = std::uint64_t(0xCD9E8D57) * counter[2];
+			counter = {std::uint32_t(p1 >> 32) ^ counter[1] ^ k[0],
+			           std::uint32_t(p1),
+			           std::uint32_t(p0 >> 32) ^ counter[3] ^ k[1],
+			           std::uint32_t(p0)};
+			k[0] += 0x9E3779B9;
+			k[1] += 0xBB67AE85;
+		}
+		return counter;
+	}
+
+	// Standard normal numbers of the path at the step, as many as out holds.
+	// Box-Muller turns every block into four of them.
+	void normals(std::uint64_t path, std::uint32_t step,
+	             std::vector<double> &out) const
+	{
+		auto uniform = [](std::uint32_t u) { return (u + 0.5) * 0x1p-32; };
+		for (auto j = 0uz; j < out.size(); j += 4) {
+			auto block = (*this)({std::uint32_t(j / 4), step,
+			                      std::uint32_t(path), std::uint32_t(path >> 32)});
+			for (auto pair = 0; pair < 2; pair++) {
+				auto r = std::sqrt(-2 * std::log(uniform(block[2 * pair])));
+				auto phi = 2 * std::numbers::pi * uniform(block[2 * pair + 1]);
+				if (j + 2 * pair < out.size())
+					out[j + 2 * pair] = r * std::cos(phi);
+				if (j + 2 * pair + 1 < out.size())
+					out[j + 2 * pair + 1] = r * std::sin(phi);
+			}
+		}
+	}
+};
+
+enum class SdeScheme { EulerMaruyama, Milstein };
+
+// Integrates dx = f(x) dt + g(x) dW with diagonal noise: component i is
+// driven by its own Wiener process with amplitude g_i(x). Milstein adds
+// g_i dg_i/dx_i (dW_i^2 - dt) / 2, the derivative is taken numerically.
+template<right_part Drift, right_part Diffusion>
+class SdeSolver {
+	double step;
+	int step_num;
+	std::vector<double> init_cond;
+	Drift drift;
+	Diffusion diffusion;
+	SdeScheme scheme;
+	Philox rng;
+
+public:
+	SdeSolver(double s, int n, const std::vector<double> &i, const Drift &f,
+	          const Diffusion &g, SdeScheme sc = SdeScheme::EulerMaruyama,
+	          std::uint64_t seed = 0)
+	  : step(s), step_num(n), init_cond(i), drift(f), diffusion(g), scheme(sc),
+	    rng(seed)
+	{
+	}
+
+	// Streams every state of the path into sink. The same path gets the same
+	// noise on every call.
+	template<solution_sink Sink>
+	void solve(std::uint64_t path, Sink &&sink, std::stop_token stop = {})
+	{
+		auto current{init_cond};
+		std::vector<double> dw(current.size());
+		std::vector<double> correction(current.size());
+		auto sqrt_step = std::sqrt(step);
+		sink(0., current);
+		for (auto i = 1; i <= step_num && !stop.stop_requested(); i++) {
+			auto t = (i - 1) * step;
+			auto f = derivative(drift, t, current);
+			auto g = derivative(diffusion, t, current);
+			rng.normals(path, i, dw);
+			for (auto &w : dw)
+				w *= sqrt_step;
+			if (scheme == SdeScheme::Milstein)
+				for (auto j = 0uz; j < current.size(); j++) {
+					auto shifted = current;
+					auto h = 1e-6 * std::max(1., std::abs(current[j]));
+					shifted[j] += h;
+					auto g_plus = derivative(diffusion, t, shifted)[j];
+					shifted[j] -= 2 * h;
+					auto g_minus = derivative(diffusion, t, shifted)[j];
+					auto dg = (g_plus - g_minus) / (2 * h);
+					correction[j] = g[j] * dg * (dw[j] * dw[j] - step) / 2;
+				}
+			for (auto j = 0uz; j < current.size(); j++)
+				current[j] += f[j] * step + g[j] * dw[j] + correction[j];
+			sink(i * step, current);
+		}
+	}
+};
+
+// Mean and variance by Welford's update, merged by Chan's formula
+struct RunningStats {
+	std::uint64_t count{};
+	double mean{};
+	double m2{}; // sum of squared deviations from the mean
+
+	void add(double x)
+	{
+		count++;
+		auto delta = x - mean;
+		mean += delta / count;
+		m2 += delta * (x - mean);
+	}
+	void merge(const RunningStats &other)
+	{
+		if (!other.count)
+			return;
+		auto n = count + other.count;
+		auto delta = other.mean - mean;
+		mean += delta * other.count / n;
+		m2 += other.m2 + delta * delta * count * other.count / n;
+		count = n;
+	}
+	double variance() const { return (count > 1) ? m2 / (count - 1) : 0; }
+};
+
+// Counts of finite values in buckets 2^-sub_bits of their power of 2 wide,
+// so quantiles are within 2^-(sub_bits+1) relative error. Merging adds
+// counts and doesn't depend on the order.
+class LogHistogram {
+	static constexpr int sub_bits = 5;
+	static constexpr int exponent_bias = 1100; // keeps keys of doubles positive
+
+	std::map<int, std::uint64_t> counts; // by key, ordered like the values
+	std::uint64_t total{};
+
+	static int key(double x)
+	{
+		if (std::abs(x) < std::numeric_limits<double>::min())
+			return 0;
+		int exponent;
+		auto mantissa = std::frexp(std::abs(x), &exponent); // in [0.5, 1)
+		auto sub = int((mantissa - 0.5) * (2 << sub_bits));
+		auto result = ((exponent + exponent_bias) << sub_bits) + sub + 1;
+		return (x < 0) ? -result : result;
+	}
+	// Middle of the bucket
+	static double value(int key)
+	{
+		if (!key)
+			return 0;
+		auto k = std::abs(key) - 1;
+		auto exponent = (k >> sub_bits) - exponent_bias;
+		auto sub = k & ((1 << sub_bits) - 1);
+		auto result = std::ldexp(0.5 + (sub + 0.5) / (2 << sub_bits), exponent);
+		return (key < 0) ? -result : result;
+	}
+
+public:
+	void add(double x)
+	{
+		if (!std::isfinite(x))
+			return;
+		counts[key(x)]++;
+		total++;
+	}
+	void merge(const LogHistogram &other)
+	{
+		for (auto [k, n] : other.counts)
+			counts[k] += n;
+		total += other.total;
+	}
+	std::uint64_t count() const { return total; }
+	// NaN if there are no values
+	double quantile(double q) const
+	{
+		if (!total)
+			return std::numeric_limits<double>::quiet_NaN();
+		auto rank = std::uint64_t(std::clamp(q, 0., 1.) * (total - 1));
+		auto seen = 0uz;
+		for (auto [k, n] : counts)
+			if ((seen += n) > rank)
+				return value(k);
+		return value(counts.rbegin()->first);
+	}
+};
+
+struct SdeParams {
+	double step{};
+	int steps{};
+	int paths{};
+	int samples{100}; // times the statistics are kept at, evenly spaced
+	std::uint64_t seed{};
+	SdeScheme scheme{SdeScheme::EulerMaruyama};
+	unsigned threads{}; // 0 means all hardware threads
+};
+
+// Distribution of the ensemble at sample times, indexed [sample][component]
+struct EnsembleStats {
+	std::vector<double> time;
+	std::vector<std::vector<RunningStats>> moments;
+	std::vector<std::vector<LogHistogram>> distribution;
+};
+
+namespace sde_detail {
+
+// Paths are reduced by chunks of this size, and chunks are merged in order
+constexpr int chunk_paths = 256;
+
+// Steps at which statistics are taken, the first and the last included
+inline std::vector<int> sample_steps(const SdeParams &params)
+{
+	auto samples = std::clamp(params.samples, 2, params.steps + 1);
+	std::vector<int> result(samples);
+	for (auto s = 0; s < samples; s++)
+		result[s] = int(std::int64_t(s) * params.steps / (samples - 1));
+	return result;
+}
+
+} // namespace sde_detail
+
+// Integrates paths of the system in parallel and reduces them on the fly to
+// moments and quantiles at sample times, the paths aren't kept. Diffusion
+// formulas may refer to aux variables and parameters of the drift. Path k
+// always gets the same noise and moments are merged in a fixed order, so the
+// result is the same for any number of threads.
+inline EnsembleStats sde_ensemble(const VectorProcessor &vp,
+                                  const std::vector<std::string> &diffusion,
+                                  const std::vector<double> &init,
+                                  const SdeParams &params)
+{
+	if (diffusion.size() != init.size())
+		throw std::invalid_argument("Every component needs a diffusion term");
+	if (params.step <= 0 || params.steps < 1 || params.paths < 1)
+		throw std::invalid_argument("Ensemble needs positive step, steps "
+		                            "and paths");
+
+	auto steps = sde_detail::sample_steps(params);
+	auto dim = init.size();
+	auto chunks = (params.paths + sde_detail::chunk_paths - 1) /
+	              sde_detail::chunk_paths;
+	using Moments = std::vector<std::vector<RunningStats>>;
+	using Distribution = std::vector<std::vector<LogHistogram>>;
+	std::vector<Moments> chunk_moments(chunks);
+
+	std::atomic<int> next{0};
+	std::exception_ptr error;
+	std::atomic_flag error_set;
+	// histograms are summed exactly, so each worker keeps its own
+	auto work = [&](Distribution &distribution) {
+		distribution.assign(steps.size(), std::vector<LogHistogram>(dim));
+		// every worker evaluates formulas of its own copy
+		auto drift = vp;
+		std::vector<FormulaProcessor> g;
+		try {
+			for (auto &text : diffusion)
+				g.emplace_back(text, &drift);
+		}
+		catch (...) {
+			if (!error_set.test_and_set())
+				error = std::current_exception();
+			next = chunks;
+			return;
+		}
+		SdeSolver solver(
+		  params.step, params.steps, init,
+		  [&drift](double t, const std::vector<double> &x) {
+			  return drift(t, x);
+		  },
+		  [&drift, &g](double t, const std::vector<double> &x) {
+			  drift.set_time(t);
+			  std::vector<double> result(x.size());
+			  for (auto j = 0uz; j < x.size(); j++)
+				  result[j] = drift(g[j], x);
+			  return result;
+		  },
+		  params.scheme, params.seed);
+
+		for (auto c = next++; c < chunks; c = next++) {
+			auto &moments = chunk_moments[c];
+			moments.assign(steps.size(), std::vector<RunningStats>(dim));
+			auto last = std::min(params.paths, (c + 1) * sde_detail::chunk_paths);
+			try {
+				for (auto path = c * sde_detail::chunk_paths; path < last; path++) {
+					auto step = 0;
+					auto sample = 0uz;
+					solver.solve(path, [&](double, const std::vector<double> &x) {
+						if (sample < steps.size() && steps[sample] == step) {
+							for (auto j = 0uz; j < dim; j++) {
+								moments[sample][j].add(x[j]);
+								distribution[sample][j].add(x[j]);
+							}
+							sample++;
+						}
+						step++;
+					});
+				}
+			}
+			catch (...) {
+				if (!error_set.test_and_set())
+					error = std::current_exception();
+				next = chunks;
+			}
+		}
+	};
+
+	auto threads_num = params.threads;
+	if (!threads_num)
+		threads_num = std::max(1u, std::thread::hardware_concurrency());
+	threads_num = std::min<unsigned>(threads_num, chunks);
+	std::vector<Distribution> distributions(threads_num);
+	{
+		std::vector<std::jthread> workers;
+		for (auto i = 1u; i < threads_num; i++)
+			workers.emplace_back(work, std::ref(distributions[i]));
+		work(distributions[0]);
+	}
+	if (error)
+		std::rethrow_exception(error);
+
+	EnsembleStats result;
+	for (auto step : steps)
+		result.time.push_back(step * params.step);
+	result.moments.assign(steps.size(), std::vector<RunningStats>(dim));
+	result.distribution = std::move(distributions[0]);
+	for (auto &moments : chunk_moments)
+		for (auto s = 0uz; s < steps.size(); s++)
+			for (auto j = 0uz; j < dim; j++)
+				result.moments[s][j].merge(moments[s][j]);
+	for (auto i = 1uz; i < distributions.size(); i++)
+		for (auto s = 0uz; s < steps.size(); s++)
+			for (auto j = 0uz; j < dim; j++)
+				result.distribution[s][j].merge(distributions[i][s][j]);
+	return result;
+}
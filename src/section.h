@@ -0,0 +1,104 @@
+#pragma once
+#include <stdexcept>
+#include <vector>
+#include "solver.h"
+
+// clang-format off
+template<typename F>
+concept section_function =
+	std::invocable<F &, const std::vector<double> &> &&
+	std::is_convertible_v<std::invoke_result_t<F &, const std::vector<double> &>,
+	                      double>;
+
+// clang-format on
+
+// Passes to the sink only the crossings of hypersurface h(x) = 0 made in the
+// direction of h growth. Crossing points are linearly interpolated between
+// two consecutive solver steps.
+template<section_function Surface, solution_sink Sink>
+class PoincareSection {
+	Surface surface;
+	Sink &sink;
+
+	bool started{false};
+	double prev_t{};
+	double prev_h{};
+	std::vector<double> prev_x;
+	std::vector<double> point;
+
+public:
+	PoincareSection(const Surface &s, Sink &out): surface(s), sink(out) {}
+
+	void operator()(double t, const std::vector<double> &x)
+	{
+		double h = surface(x);
+		if (started && prev_h < 0 && h >= 0) {
+			auto alpha = -prev_h / (h - prev_h);
+			point.resize(x.size());
+			for (auto j = 0u; j < x.size(); j++)
+				point[j] = prev_x[j] + alpha * (x[j] - prev_x[j]);
+			sink(prev_t + alpha * (t - prev_t), point);
+		}
+		started = true;
+		prev_t = t;
+		prev_h = h;
+		prev_x = x;
+	}
+};
+
+// Passes every k-th point to the sink starting from the first one, so a long
+// trajectory fits in memory
+template<solution_sink Sink>
+class Decimation {
+	size_t every;
+	Sink &sink;
+	size_t count{0};
+
+public:
+	Decimation(size_t k, Sink &out): every(k), sink(out) {}
+
+	void operator()(double t, const std::vector<double> &x)
+	{
+		if (count++ % every == 0)
+			sink(t, x);
+	}
+};
+
+// Passes to the sink states at times 0, T, 2T, ... interpolated between two
+// consecutive solver steps
+template<solution_sink Sink>
+class StroboscopicSection {
+	double period;
+	Sink &sink;
+
+	long long samples{0};
+	double prev_t{};
+	std::vector<double> prev_x;
+	std::vector<double> point;
+
+	double next_t() const { return samples * period; }
+
+public:
+	StroboscopicSection(double p, Sink &out): period(p), sink(out)
+	{
+		if (!(period > 0))
+			throw std::invalid_argument("Stroboscopic period must be positive");
+	}
+
+	void operator()(double t, const std::vector<double> &x)
+	{
+		if (prev_x.empty()) {
+			for (; next_t() <= t; samples++)
+				sink(t, x);
+		}
+		for (; next_t() <= t; samples++) {
+			auto alpha = (next_t() - prev_t) / (t - prev_t);
+			point.resize(x.size());
+			for (auto j = 0u; j < x.size(); j++)
+				point[j] = prev_x[j] + alpha * (x[j] - prev_x[j]);
+			sink(next_t(), point);
+		}
+		prev_t = t;
+		prev_x = x;
+	}
+};
@@ -0,0 +1,103 @@
+#include "solve_job.h"
+#include "trace.h"
+
+using namespace std;
+
+// GUI takes new points this often
+constexpr int frame_ms = 33;
+// Rows buffered by the solver before they are passed to the job
+constexpr size_t sink_rows = 1024;
+// Staged values after which the solver waits for GUI
+constexpr size_t max_staged = 1 << 22;
+
+void SolveJob::Sink::operator()(double t, const vector<double> &x)
+{
+	width = x.size() + 1;
+	rows.push_back(t);
+	rows.insert(rows.end(), x.begin(), x.end());
+	if (rows.size() >= sink_rows * width)
+		push();
+}
+
+void SolveJob::Sink::push()
+{
+	if (rows.empty())
+		return;
+	unique_lock lock(job.mutex);
+	job.drained.wait(lock, stop,
+	                 [this]() { return job.staging.size() < max_staged; });
+	job.row_size = width;
+	job.staging.insert(job.staging.end(), rows.begin(), rows.end());
+	rows.clear();
+}
+
+SolveJob::SolveJob(shared_ptr<TrajectoryStorage> s, QObject *parent)
+  : QObject(parent), storage(std::move(s)), timer(new QTimer(this))
+{
+	timer->setInterval(frame_ms);
+	connect(timer, &QTimer::timeout, this, &SolveJob::flush);
+}
+
+SolveJob::~SolveJob()
+{
+	worker.request_stop();
+	drained.notify_all();
+}
+
+void SolveJob::start(Solve solve)
+{
+	worker = jthread([this, solve](const stop_token &stop) {
+		Sink sink(*this, stop);
+		exception_ptr e;
+		try {
+			solve(sink, stop);
+			sink.push();
+		}
+		catch (...) {
+			e = current_exception();
+		}
+		lock_guard lock(mutex);
+		error = e;
+		done = true;
+	});
+	timer->start();
+}
+
+void SolveJob::flush()
+{
+	vector<double> rows;
+	bool finished_now;
+	size_t width;
+	{
+		lock_guard lock(mutex);
+		rows.swap(staging);
+		finished_now = done;
+		width = row_size;
+	}
+	drained.notify_all();
+
+	if (!rows.empty()) {
+		ScopedTimer append_timer("append");
+		vector<double> x;
+		for (auto i = 0uz; i < rows.size(); i += width) {
+			x.assign(rows.begin() + i + 1, rows.begin() + i + width);
+			(*storage)(rows[i], x);
+		}
+		append_timer.add_items(rows.size() / width);
+		Trace::instance().count("points", rows.size() / width);
+		emit appended();
+	}
+
+	if (!finished_now)
+		return;
+	timer->stop();
+	if (error) {
+		try {
+			rethrow_exception(error);
+		}
+		catch (exception &e) {
+			emit failed(e.what());
+		}
+	}
+	emit finished();
+}
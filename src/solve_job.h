@@ -0,0 +1,58 @@
+#pragma once
+#include <QObject>
+#include <QTimer>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+#include "trajectory.h"
+
+// Integrates equations on a worker thread. Solver output is handed to the GUI
+// thread in batches at a bounded frame rate and appended to the storage
+// there, so charts can be drawn while the solver is still running.
+class SolveJob : public QObject {
+	Q_OBJECT
+
+public:
+	// Passes points to the job, blocks the solver if GUI lags behind
+	class Sink {
+		SolveJob &job;
+		const std::stop_token &stop;
+		std::vector<double> rows; // t, x1, ..., xn
+		size_t width{0};
+
+	public:
+		Sink(SolveJob &j, const std::stop_token &s): job(j), stop(s) {}
+		void operator()(double t, const std::vector<double> &x);
+		void push();
+	};
+	using Solve = std::function<void(Sink &, const std::stop_token &)>;
+
+	SolveJob(std::shared_ptr<TrajectoryStorage> s, QObject *parent);
+	// Cancels unfinished solve
+	~SolveJob() override;
+	void start(Solve solve);
+	bool running() const { return timer->isActive(); }
+
+signals:
+	void appended();
+	void failed(const QString &error);
+	void finished();
+
+private:
+	std::shared_ptr<TrajectoryStorage> storage;
+	std::mutex mutex;
+	std::condition_variable_any drained;
+	std::vector<double> staging; // rows of t, x1, ..., xn
+	size_t row_size{0};
+	bool done{false};
+	std::exception_ptr error;
+	QTimer *timer;
+	std::jthread worker;
+
+	void flush();
+};
@@ -1,17 +1,63 @@
 #pragma once
 #include <concepts>
+#include <stop_token>
 #include <type_traits>
 #include <vector>
 
 // clang-format off
+// Right part f(t, x) of x' = f, autonomous ones may take just the state
 template<typename F>
 concept right_part =
-	std::invocable<F, std::vector<double>> &&
-	std::is_same_v<std::vector<double>,
-	               std::invoke_result_t<F &, std::vector<double>>>;
+	(std::invocable<F, std::vector<double>> &&
+	 std::is_same_v<std::vector<double>,
+	                std::invoke_result_t<F &, std::vector<double>>>) ||
+	(std::invocable<F, double, std::vector<double>> &&
+	 std::is_same_v<std::vector<double>,
+	                std::invoke_result_t<F &, double, std::vector<double>>>);
+
+// Receives solver output point by point: time and state
+template<typename S>
+concept solution_sink =
+	std::invocable<S &, double, const std::vector<double> &>;
 
 // clang-format on
 
+template<right_part F>
+std::vector<double> derivative(F &rp, double t, const std::vector<double> &x)
+{
+	if constexpr (std::invocable<F &, double, const std::vector<double> &>)
+		return rp(t, x);
+	else
+		return rp(x);
+}
+
+// Keeps every point passed by the solver
+struct Trajectory {
+	std::vector<double> time;
+	std::vector<std::vector<double>> states;
+
+	void operator()(double t, const std::vector<double> &x)
+	{
+		time.push_back(t);
+		states.push_back(x);
+	}
+	size_t size() const { return states.size(); }
+};
+
+// Cubic Hermite interpolant of a step from (t0, x0) to (t1, x1) with
+// derivatives d0 and d1 at its ends: dense output between stored states.
+// Euler states carry their derivatives, the one at a state is the slope of
+// the step taken from it.
+inline double hermite(double t0, double x0, double d0, double t1, double x1,
+                      double d1, double t)
+{
+	auto h = t1 - t0;
+	auto s = (t - t0) / h;
+	auto s2 = s * s, s3 = s2 * s;
+	return (2 * s3 - 3 * s2 + 1) * x0 + (s3 - 2 * s2 + s) * h * d0 +
+	       (3 * s2 - 2 * s3) * x1 + (s3 - s2) * h * d1;
+}
+
 template<right_part RightPart>
 class EulerSolver {
 	double step;
@@ -24,19 +70,29 @@ public:
 	  : step(s), step_num(n), init_cond(i), rp(r)
 	{
 	}
-	std::vector<std::vector<double>> solve()
+
+	// Streams every state into sink without keeping the whole solution.
+	// Stops early if stop is requested.
+	template<solution_sink Sink>
+	void solve(Sink &&sink, std::stop_token stop = {})
 	{
-		std::vector<std::vector<double>> result;
-		result.push_back(init_cond);
-		for (auto i = 1; i <= step_num; i++) {
-			auto next{result.back()};
-			auto deriv = rp(result.back());
-			for (auto j = 0u; j < next.size(); j++) {
-				next[j] += deriv[j] * step;
+		auto current{init_cond};
+		sink(0., current);
+		for (auto i = 1; i <= step_num && !stop.stop_requested(); i++) {
+			auto deriv = derivative(rp, (i - 1) * step, current);
+			for (auto j = 0u; j < current.size(); j++) {
+				current[j] += deriv[j] * step;
 			}
-			result.push_back(next);
+			sink(i * step, current);
 		}
+	}
 
+	std::vector<std::vector<double>> solve()
+	{
+		std::vector<std::vector<double>> result;
+		solve([&result](double, const std::vector<double> &x) {
+			result.push_back(x);
+		});
 		return result;
 	}
 };
@@ -0,0 +1,85 @@
+#pragma once
+#include <QHash>
+#include <QPointF>
+#include <QRectF>
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+
+// Uniform grid over label anchors in chart coordinates. Cell size is chosen
+// from the chart range at rebuild time; queries stay correct after zoom,
+// they just visit more or fewer cells.
+class TextIndex {
+	struct Entry {
+		int idx;
+		QPointF anchor;
+	};
+	static constexpr int grid = 32; // cells along the chart range
+	double cell_w{1};
+	double cell_h{1};
+	QHash<quint64, QVector<Entry>> cells;
+
+	// Cells far away or of non-finite coordinates are clamped, so they
+	// convert to integers
+	static qint64 cell(double x, double size)
+	{
+		constexpr double limit = 1 << 30;
+		auto c = std::floor(x / size);
+		return std::isnan(c) ? 0 : qint64(std::clamp(c, -limit, limit));
+	}
+	qint64 column(double x) const { return cell(x, cell_w); }
+	qint64 row(double y) const { return cell(y, cell_h); }
+	static quint64 key(qint64 col, qint64 row)
+	{
+		return (quint64(col) << 32) ^ quint64(quint32(row));
+	}
+	quint64 key(QPointF p) const { return key(column(p.x()), row(p.y())); }
+
+public:
+	void rebuild(const QVector<QPointF> &anchors, const QRectF &range)
+	{
+		cells.clear();
+		if (range.width() > 0)
+			cell_w = range.width() / grid;
+		if (range.height() > 0)
+			cell_h = range.height() / grid;
+		for (auto i = 0; i < anchors.size(); i++)
+			cells[key(anchors[i])].append({i, anchors[i]});
+	}
+
+	void move(int idx, QPointF from, QPointF to)
+	{
+		auto &old_cell = cells[key(from)];
+		for (auto i = 0; i < old_cell.size(); i++)
+			if (old_cell[i].idx == idx)
+				old_cell.removeAt(i--);
+		cells[key(to)].append({idx, to});
+	}
+
+	// Indexes of anchors inside area
+	QVector<int> find(const QRectF &area) const
+	{
+		QVector<int> result;
+		auto add = [&result, &area](const QVector<Entry> &cell) {
+			for (auto &e : cell)
+				if (area.contains(e.anchor))
+					result.append(e.idx);
+		};
+		// huge areas are cheaper to check cell by cell, the count is taken in
+		// double as it may not fit in integers
+		auto cols = std::floor(area.right() / cell_w) -
+		            std::floor(area.left() / cell_w) + 1;
+		auto rows = std::floor(area.bottom() / cell_h) -
+		            std::floor(area.top() / cell_h) + 1;
+		if (!(cols * rows <= cells.size())) {
+			for (auto &cell : cells)
+				add(cell);
+			return result;
+		}
+		for (auto col = column(area.left()); col <= column(area.right()); col++)
+			for (auto r = row(area.top()); r <= row(area.bottom()); r++)
+				if (auto cell = cells.find(key(col, r)); cell != cells.end())
+					add(*cell);
+		return result;
+	}
+};
@@ -0,0 +1,125 @@
+#include <atomic>
+#include <nlohmann/json.hpp>
+#include "trace.h"
+
+using namespace std;
+
+thread_local uint64_t trace_detail::allocations = 0;
+
+namespace {
+
+// Oldest element first, ring is rotated only once it is full
+template<typename T>
+vector<T> unwrap(const vector<T> &ring, size_t next, size_t capacity)
+{
+	if (ring.size() < capacity)
+		next = 0;
+	vector<T> result(ring.begin() + next, ring.end());
+	result.insert(result.end(), ring.begin(), ring.begin() + next);
+	return result;
+}
+
+} // namespace
+
+uint64_t thread_allocations()
+{
+	return trace_detail::allocations;
+}
+
+Trace &Trace::instance()
+{
+	static Trace trace;
+	return trace;
+}
+
+int64_t Trace::now_us()
+{
+	using namespace chrono;
+	static auto start = steady_clock::now();
+	return duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+unsigned Trace::thread_id()
+{
+	static atomic<unsigned> next{1};
+	thread_local unsigned id = next++;
+	return id;
+}
+
+void Trace::record(const Span &span)
+{
+	lock_guard lock(mutex);
+	if (spans.size() < max_spans)
+		spans.push_back(span);
+	else
+		spans[next_span] = span;
+	next_span = (next_span + 1) % max_spans;
+
+	auto &stage = totals[span.name];
+	stage.calls++;
+	stage.total_us += span.duration_us;
+	stage.last_us = span.duration_us;
+	stage.max_us = max(stage.max_us, span.duration_us);
+	stage.items += span.items;
+	stage.allocations += span.allocations;
+}
+
+void Trace::count(const char *name, int64_t n)
+{
+	auto time = now_us();
+	lock_guard lock(mutex);
+	auto value = values[name] += n;
+	if (samples.size() < max_spans)
+		samples.push_back({name, time, value});
+	else
+		samples[next_sample] = {name, time, value};
+	next_sample = (next_sample + 1) % max_spans;
+}
+
+map<string, Trace::Stage> Trace::stages() const
+{
+	lock_guard lock(mutex);
+	return totals;
+}
+
+map<string, int64_t> Trace::counters() const
+{
+	lock_guard lock(mutex);
+	return values;
+}
+
+void Trace::clear()
+{
+	lock_guard lock(mutex);
+	spans.clear();
+	next_span = 0;
+	samples.clear();
+	next_sample = 0;
+	totals.clear();
+	values.clear();
+}
+
+void Trace::write_chrome_trace(ostream &out) const
+{
+	nlohmann::json events = nlohmann::json::array();
+	{
+		lock_guard lock(mutex);
+		for (auto &span : unwrap(spans, next_span, max_spans))
+			events.push_back({{"name", span.name},
+			                  {"ph", "X"},
+			                  {"ts", span.start_us},
+			                  {"dur", span.duration_us},
+			                  {"pid", 1},
+			                  {"tid", span.thread},
+			                  {"args",
+			                   {{"items", span.items},
+			                    {"allocations", span.allocations}}}});
+		for (auto &s : unwrap(samples, next_sample, max_spans))
+			events.push_back({{"name", s.name},
+			                  {"ph", "C"},
+			                  {"ts", s.time_us},
+			                  {"pid", 1},
+			                  {"args", {{s.name, s.value}}}});
+	}
+	out << nlohmann::json{{"traceEvents", events}, {"displayTimeUnit", "ms"}};
+}
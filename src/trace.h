@@ -0,0 +1,95 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace trace_detail {
+extern thread_local std::uint64_t allocations;
+}
+
+// Heap allocations made by the current thread. Only programs linked with
+// allocation_counter.cpp count them, elsewhere it stays zero.
+std::uint64_t thread_allocations();
+
+// Timings of pipeline stages and counters of what they produced. Stages are
+// coarse (a parse, a solve, a paint), so a mutex is cheap enough here.
+class Trace {
+public:
+	struct Span {
+		const char *name;
+		std::int64_t start_us;
+		std::int64_t duration_us;
+		unsigned thread;
+		std::uint64_t items;       // evaluations, points... of the stage
+		std::uint64_t allocations; // made by the stage thread meanwhile
+	};
+	// Totals of spans with the same name
+	struct Stage {
+		std::uint64_t calls{};
+		std::int64_t total_us{};
+		std::int64_t last_us{};
+		std::int64_t max_us{};
+		std::uint64_t items{};
+		std::uint64_t allocations{};
+	};
+
+	static Trace &instance();
+	// Microseconds since the start of the program
+	static std::int64_t now_us();
+	// Small number of the calling thread
+	static unsigned thread_id();
+
+	void record(const Span &span);
+	void count(const char *name, std::int64_t n);
+	std::map<std::string, Stage> stages() const;
+	std::map<std::string, std::int64_t> counters() const;
+	void clear();
+	// Chrome trace event format, opens in chrome://tracing and Perfetto
+	void write_chrome_trace(std::ostream &out) const;
+
+private:
+	// Spans kept for export, older ones are dropped
+	static constexpr size_t max_spans = 1 << 16;
+
+	struct CounterSample {
+		const char *name;
+		std::int64_t time_us;
+		std::int64_t value;
+	};
+
+	mutable std::mutex mutex;
+	std::vector<Span> spans; // ring buffer once full
+	size_t next_span{0};
+	std::vector<CounterSample> samples;
+	size_t next_sample{0};
+	std::map<std::string, Stage> totals;
+	std::map<std::string, std::int64_t> values;
+};
+
+// Records time between construction and destruction as a span of the stage
+class ScopedTimer {
+	const char *name;
+	std::int64_t start;
+	std::uint64_t allocations;
+	std::uint64_t items{0};
+
+public:
+	explicit ScopedTimer(const char *stage)
+	  : name(stage), start(Trace::now_us()), allocations(thread_allocations())
+	{
+	}
+	~ScopedTimer()
+	{
+		Trace::instance().record({name, start, Trace::now_us() - start,
+		                          Trace::thread_id(), items,
+		                          thread_allocations() - allocations});
+	}
+	ScopedTimer(const ScopedTimer &) = delete;
+	ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+	void add_items(std::uint64_t n) { items += n; }
+};
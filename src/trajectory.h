@@ -0,0 +1,339 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+// How solved trajectory is kept in memory
+enum class StorageMode {
+	Double,     // full precision
+	Float,      // float32 columns, enough for plotting
+	Compressed, // lossless XOR/delta codec
+};
+
+// Column oriented solver output. Column -1 is time like in ComponentChoice.
+class TrajectoryStorage {
+public:
+	virtual ~TrajectoryStorage() = default;
+	virtual void operator()(double t, const std::vector<double> &x) = 0;
+	virtual size_t size() const = 0;
+	virtual size_t dimension() const = 0;
+	virtual size_t memory() const = 0; // bytes
+	// Decodes count values of component comp starting from index first
+	virtual void read(int comp, size_t first, size_t count,
+	                  double *out) const = 0;
+
+	// Single values cost a decode of the whole block on compressed storage,
+	// loops should use for_each_point
+	double value(int comp, size_t k) const
+	{
+		double result;
+		read(comp, k, 1, &result);
+		return result;
+	}
+	// Calls f(x, y) for points of the two components from index first on,
+	// they are read in chunks
+	template<typename F>
+	void for_each_point(int x_comp, int y_comp, size_t first, F &&f) const
+	{
+		constexpr size_t chunk = 4096;
+		std::vector<double> xs(chunk), ys(chunk);
+		for (auto k = first, end = size(); k < end; k += chunk) {
+			auto n = std::min(chunk, end - k);
+			read(x_comp, k, n, xs.data());
+			read(y_comp, k, n, ys.data());
+			for (auto i = 0uz; i < n; i++)
+				f(xs[i], ys[i]);
+		}
+	}
+};
+
+template<typename T>
+class ColumnStorage : public TrajectoryStorage {
+	std::vector<T> time;
+	std::vector<std::vector<T>> columns;
+
+	const std::vector<T> &column(int comp) const
+	{
+		return (comp == -1) ? time : columns.at(comp);
+	}
+
+public:
+	void operator()(double t, const std::vector<double> &x) override
+	{
+		if (columns.empty())
+			columns.resize(x.size());
+		time.push_back(t);
+		for (auto j = 0u; j < x.size(); j++)
+			columns[j].push_back(x[j]);
+	}
+	size_t size() const override { return time.size(); }
+	size_t dimension() const override { return columns.size(); }
+	size_t memory() const override
+	{
+		auto result = time.capacity();
+		for (auto &c : columns)
+			result += c.capacity();
+		return result * sizeof(T);
+	}
+	void read(int comp, size_t first, size_t count,
+	          double *out) const override
+	{
+		auto &c = column(comp);
+		if (first + count > c.size())
+			throw std::out_of_range("ColumnStorage read past the end");
+		std::copy(c.begin() + first, c.begin() + first + count, out);
+	}
+};
+
+class BitWriter {
+	std::vector<uint64_t> &words;
+	size_t &bits;
+
+public:
+	BitWriter(std::vector<uint64_t> &w, size_t &b): words(w), bits(b) {}
+	// Writes n lowest bits of value, n <= 64
+	void write(uint64_t value, int n)
+	{
+		if (!n)
+			return;
+		if (n < 64)
+			value &= (uint64_t{1} << n) - 1;
+		auto offset = bits % 64;
+		if (!offset)
+			words.push_back(0);
+		words.back() |= value << offset;
+		if (offset + n > 64) {
+			words.push_back(value >> (64 - offset));
+		}
+		bits += n;
+	}
+};
+
+class BitReader {
+	const uint64_t *words;
+	size_t bits;
+
+public:
+	BitReader(const uint64_t *w, size_t b): words(w), bits(b) {}
+	uint64_t read(int n)
+	{
+		if (!n)
+			return 0;
+		auto offset = bits % 64;
+		auto idx = bits / 64;
+		uint64_t value = words[idx] >> offset;
+		if (offset + n > 64)
+			value |= words[idx + 1] << (64 - offset);
+		if (n < 64)
+			value &= (uint64_t{1} << n) - 1;
+		bits += n;
+		return value;
+	}
+};
+
+// Lossless codec for smooth sequences of doubles. Every value is XORed with
+// extrapolation of the previous ones, so only a few meaningful bits of the
+// residual are stored. Values are grouped in independent blocks to allow
+// random access.
+class XorColumn {
+	std::vector<uint64_t> words;
+	size_t bits{0};
+	std::vector<size_t> block_offsets;
+	size_t values{0};
+
+	// encoder state
+	double prev{};
+	double prev_prev{};
+	double prev_prev_prev{};
+	int window_lead{-1};
+	int window_len{0};
+
+public:
+	static constexpr size_t block_size = 1024;
+	static constexpr int window_header = 12;
+	// of a value with a new window of all 64 bits
+	static constexpr int max_bits = 2 + window_header + 64;
+
+	// Polynomial extrapolation of previous values, exact for quadratic ones
+	static double predict(size_t idx_in_block, double p, double pp, double ppp)
+	{
+		switch (idx_in_block) {
+		case 0:
+			return 0;
+		case 1:
+			return p;
+		case 2:
+			return 2 * p - pp;
+		default:
+			return 3 * (p - pp) + ppp;
+		}
+	}
+
+	void append(double value)
+	{
+		auto in_block = values % block_size;
+		if (!in_block) {
+			block_offsets.push_back(bits);
+			window_lead = -1;
+		}
+		BitWriter writer(words, bits);
+		auto predicted = predict(in_block, prev, prev_prev, prev_prev_prev);
+		auto residual =
+		  std::bit_cast<uint64_t>(value) ^ std::bit_cast<uint64_t>(predicted);
+		if (!residual) {
+			writer.write(0, 1);
+		}
+		else {
+			int lead = std::countl_zero(residual);
+			int trail = std::countr_zero(residual);
+			int len = 64 - lead - trail;
+			// previous window is reused unless it wastes more than a new header
+			writer.write(1, 1);
+			if (window_lead >= 0 && lead >= window_lead &&
+			    64 - trail <= window_lead + window_len &&
+			    window_len - len <= window_header) {
+				writer.write(0, 1);
+			}
+			else {
+				window_lead = lead;
+				window_len = len;
+				writer.write(1, 1);
+				writer.write(window_lead, 6);
+				writer.write(window_len - 1, 6);
+			}
+			auto shift = 64 - window_lead - window_len;
+			writer.write(residual >> shift, window_len);
+		}
+		prev_prev_prev = prev_prev;
+		prev_prev = prev;
+		prev = value;
+		values++;
+	}
+
+	size_t size() const { return values; }
+	size_t memory() const
+	{
+		return words.capacity() * sizeof(uint64_t) +
+		       block_offsets.capacity() * sizeof(size_t);
+	}
+
+	// Streaming decoder, starts from the beginning of a block
+	class Decoder {
+		BitReader reader;
+		size_t in_block{0};
+		double prev{};
+		double prev_prev{};
+		double prev_prev_prev{};
+		int window_lead{-1};
+		int window_len{0};
+
+	public:
+		Decoder(const XorColumn &c, size_t block)
+		  : reader(c.words.data(), c.block_offsets[block])
+		{
+		}
+		double next()
+		{
+			auto predicted = std::bit_cast<uint64_t>(
+			  predict(in_block, prev, prev_prev, prev_prev_prev));
+			uint64_t residual = 0;
+			if (reader.read(1)) {
+				if (reader.read(1)) {
+					window_lead = reader.read(6);
+					window_len = reader.read(6) + 1;
+				}
+				auto shift = 64 - window_lead - window_len;
+				residual = reader.read(window_len) << shift;
+			}
+			auto value = std::bit_cast<double>(predicted ^ residual);
+			prev_prev_prev = prev_prev;
+			prev_prev = prev;
+			prev = value;
+			in_block++;
+			return value;
+		}
+	};
+
+	void read(size_t first, size_t count, double *out) const
+	{
+		if (first + count > values)
+			throw std::out_of_range("XorColumn read past the end");
+		while (count) {
+			auto block = first / block_size;
+			Decoder decoder(*this, block);
+			auto skip = first % block_size;
+			for (auto i = 0u; i < skip; i++)
+				decoder.next();
+			auto n = std::min(count, block_size - skip);
+			for (auto i = 0u; i < n; i++)
+				*out++ = decoder.next();
+			first += n;
+			count -= n;
+		}
+	}
+};
+
+class CompressedStorage : public TrajectoryStorage {
+	XorColumn time;
+	std::vector<XorColumn> columns;
+
+public:
+	void operator()(double t, const std::vector<double> &x) override
+	{
+		if (columns.empty())
+			columns.resize(x.size());
+		time.append(t);
+		for (auto j = 0u; j < x.size(); j++)
+			columns[j].append(x[j]);
+	}
+	size_t size() const override { return time.size(); }
+	size_t dimension() const override { return columns.size(); }
+	size_t memory() const override
+	{
+		auto result = time.memory();
+		for (auto &c : columns)
+			result += c.memory();
+		return result;
+	}
+	void read(int comp, size_t first, size_t count,
+	          double *out) const override
+	{
+		auto &c = (comp == -1) ? time : columns.at(comp);
+		c.read(first, count, out);
+	}
+};
+
+// Upper bound of memory taken by points with dimension components, spare
+// capacity of growing vectors included. Compressed values are counted at the
+// worst case of the codec, usually they take several times less.
+inline size_t storage_estimate(StorageMode mode, size_t dimension,
+                               size_t points)
+{
+	size_t column;
+	if (mode == StorageMode::Compressed) {
+		auto words = (points * XorColumn::max_bits + 63) / 64 + 1;
+		auto blocks = points / XorColumn::block_size + 1;
+		column = words * sizeof(uint64_t) + blocks * sizeof(size_t);
+	}
+	else {
+		auto bytes =
+		  (mode == StorageMode::Float) ? sizeof(float) : sizeof(double);
+		column = bytes * points;
+	}
+	return 2 * column * (dimension + 1);
+}
+
+inline std::unique_ptr<TrajectoryStorage> make_storage(StorageMode mode)
+{
+	switch (mode) {
+	case StorageMode::Float:
+		return std::make_unique<ColumnStorage<float>>();
+	case StorageMode::Compressed:
+		return std::make_unique<CompressedStorage>();
+	default:
+		return std::make_unique<ColumnStorage<double>>();
+	}
+}
@@ -0,0 +1,272 @@
+#pragma once
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "solver.h"
+#include "trajectory.h"
+
+// Solver output written to disk while integrating. Memory use doesn't depend
+// on the number of steps.
+class TrajectoryWriter {
+public:
+	virtual ~TrajectoryWriter() = default;
+	virtual void operator()(double t, const std::vector<double> &x) = 0;
+	// Writes buffered data, throws if anything failed
+	virtual void close() = 0;
+};
+
+// Text table with header t,x1,...,xn. Values are printed in the shortest
+// form which reads back exactly.
+class CsvWriter : public TrajectoryWriter {
+	static constexpr size_t buffer_size = 1 << 20;
+
+	std::ofstream file;
+	std::string path;
+	std::string buffer;
+	bool header_written{false};
+
+	void flush()
+	{
+		file.write(buffer.data(), buffer.size());
+		buffer.clear();
+		if (!file)
+			throw std::runtime_error("Can't write " + path);
+	}
+	void append(double value)
+	{
+		char number[32];
+		auto end = std::to_chars(number, number + sizeof(number), value).ptr;
+		buffer.append(number, end);
+	}
+
+public:
+	CsvWriter(const std::string &p): file(p, std::ios::binary), path(p)
+	{
+		if (!file)
+			throw std::runtime_error("Can't open " + path);
+		buffer.reserve(buffer_size);
+	}
+	~CsvWriter() override
+	{
+		if (file.is_open())
+			file.write(buffer.data(), buffer.size());
+	}
+
+	void operator()(double t, const std::vector<double> &x) override
+	{
+		if (!header_written) {
+			buffer += "t";
+			for (auto j = 1u; j <= x.size(); j++)
+				buffer += ",x" + std::to_string(j);
+			buffer += '\n';
+			header_written = true;
+		}
+		append(t);
+		for (auto v : x) {
+			buffer += ',';
+			append(v);
+		}
+		buffer += '\n';
+		if (buffer.size() >= buffer_size)
+			flush();
+	}
+	void close() override
+	{
+		flush();
+		file.close();
+	}
+};
+
+// Little-endian binary file of double columns, time first. Rows are grouped
+// in blocks of block_rows, every block keeps its columns one after another,
+// so a column is read without touching the others and writing needs only one
+// block of memory:
+//   header: magic[8], uint32 version, uint32 columns, uint64 rows,
+//           uint64 block_rows
+//   blocks: column 0 values, column 1 values, ... (last block may be short)
+struct BinaryHeader {
+	static constexpr char magic[8] = {'D', 'C', 'P', 'P', 'T', 'R', 'A', 'J'};
+	static constexpr uint32_t version = 1;
+	static constexpr size_t size = 32;
+
+	uint32_t columns{};
+	uint64_t rows{};
+	uint64_t block_rows{};
+
+	// Offset of value of column in row
+	uint64_t offset(uint32_t column, uint64_t row) const
+	{
+		auto block = row / block_rows;
+		auto first = block * block_rows;
+		auto rows_in_block = std::min(block_rows, rows - first);
+		return size + (first * columns + column * rows_in_block + row - first) *
+		                sizeof(double);
+	}
+};
+
+template<typename T>
+T little_endian(T value)
+{
+	if constexpr (std::endian::native == std::endian::big)
+		return std::byteswap(value);
+	return value;
+}
+
+class BinaryWriter : public TrajectoryWriter {
+	std::ofstream file;
+	std::string path;
+	BinaryHeader header;
+	std::vector<std::vector<uint64_t>> block; // by column
+	std::vector<char> bytes;
+
+	template<typename T>
+	void put(T value)
+	{
+		value = little_endian(value);
+		file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+	}
+	void write_header()
+	{
+		file.seekp(0);
+		file.write(BinaryHeader::magic, sizeof(BinaryHeader::magic));
+		put(BinaryHeader::version);
+		put(header.columns);
+		put(header.rows);
+		put(header.block_rows);
+	}
+	void flush()
+	{
+		for (auto &column : block) {
+			bytes.resize(column.size() * sizeof(double));
+			for (auto i = 0uz; i < column.size(); i++) {
+				auto v = little_endian(column[i]);
+				std::memcpy(bytes.data() + i * sizeof(v), &v, sizeof(v));
+			}
+			file.write(bytes.data(), bytes.size());
+			column.clear();
+		}
+		if (!file)
+			throw std::runtime_error("Can't write " + path);
+	}
+
+public:
+	static constexpr uint64_t default_block_rows = 1 << 16;
+
+	BinaryWriter(const std::string &p, uint64_t block_rows = default_block_rows)
+	  : file(p, std::ios::binary), path(p)
+	{
+		if (!file)
+			throw std::runtime_error("Can't open " + path);
+		header.block_rows = block_rows;
+		write_header();
+	}
+	// Keeps the file readable if close wasn't called
+	~BinaryWriter() override
+	{
+		if (!file.is_open())
+			return;
+		try {
+			close();
+		}
+		catch (...) {
+		}
+	}
+
+	void operator()(double t, const std::vector<double> &x) override
+	{
+		if (block.empty()) {
+			header.columns = x.size() + 1;
+			block.resize(header.columns);
+		}
+		block[0].push_back(std::bit_cast<uint64_t>(t));
+		for (auto j = 0uz; j < x.size(); j++)
+			block[j + 1].push_back(std::bit_cast<uint64_t>(x[j]));
+		header.rows++;
+		if (block[0].size() == header.block_rows)
+			flush();
+	}
+	void close() override
+	{
+		flush();
+		write_header(); // rows are known only now
+		file.close();
+		if (!file)
+			throw std::runtime_error("Can't write " + path);
+	}
+};
+
+// CSV for .csv files, binary otherwise
+inline std::unique_ptr<TrajectoryWriter> make_writer(const std::string &path)
+{
+	if (path.ends_with(".csv"))
+		return std::make_unique<CsvWriter>(path);
+	return std::make_unique<BinaryWriter>(path);
+}
+
+inline BinaryHeader read_header(std::istream &in)
+{
+	char magic[sizeof(BinaryHeader::magic)];
+	uint32_t version;
+	BinaryHeader header;
+	auto get = [&in](auto &value) {
+		in.read(reinterpret_cast<char *>(&value), sizeof(value));
+		value = little_endian(value);
+	};
+	in.read(magic, sizeof(magic));
+	get(version);
+	get(header.columns);
+	get(header.rows);
+	get(header.block_rows);
+	if (!in || std::memcmp(magic, BinaryHeader::magic, sizeof(magic)) ||
+	    version != BinaryHeader::version || !header.columns ||
+	    !header.block_rows)
+		throw std::runtime_error("Not a trajectory file");
+	return header;
+}
+
+// Reads binary trajectory file into storage block by block
+inline void load_trajectory(const std::string &path, TrajectoryStorage &storage)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Can't open " + path);
+	auto header = read_header(file);
+	std::vector<double> block;
+	std::vector<double> x(header.columns - 1);
+	for (auto first = 0uz; first < header.rows; first += header.block_rows) {
+		auto n = std::min(header.block_rows, header.rows - first);
+		block.resize(n * header.columns);
+		file.read(reinterpret_cast<char *>(block.data()),
+		          block.size() * sizeof(double));
+		if (!file)
+			throw std::runtime_error("Trajectory file is truncated");
+		for (auto &v : block)
+			v = std::bit_cast<double>(little_endian(std::bit_cast<uint64_t>(v)));
+		for (auto i = 0uz; i < n; i++) {
+			for (auto j = 0uz; j < x.size(); j++)
+				x[j] = block[(j + 1) * n + i];
+			storage(block[i], x);
+		}
+	}
+}
+
+// Passes every point to both sinks
+template<solution_sink First, solution_sink Second>
+class TeeSink {
+	First &first;
+	Second &second;
+
+public:
+	TeeSink(First &a, Second &b): first(a), second(b) {}
+	void operator()(double t, const std::vector<double> &x)
+	{
+		first(t, x);
+		second(t, x);
+	}
+};
@@ -22,10 +22,13 @@ class ControlPanel : public QWidget {
 	MainWindow *mw;
 	QPushButton *zoom_button;
 	QString save_file{};
+	QLabel *trace_text; // timings of the last pipeline stages
 
 	void on_save();
 	void save(const QString &filename);
 	void on_open();
+	void update_trace();
+	void save_trace();
 
 public:
 	ControlPanel(MainWindow *parent = nullptr);
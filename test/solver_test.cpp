@@ -0,0 +1,501 @@
+#include <gtest/gtest.h>
+#include <formula_processor.h>
+#include <section.h>
+#include <bifurcation.h>
+#include <lod_pyramid.h>
+#include <trajectory_file.h>
+#include <density.h>
+#include <sde.h>
+#include <lookup_table.h>
+#include <filesystem>
+#include <fstream>
+#include <cmath>
+#include <numbers>
+#include <random>
+
+using namespace std::string_literals;
+
+TEST(solver, streaming_solve)
+{
+	VectorProcessor vp;
+	vp[1] = "1";
+	EulerSolver solver(0.5, 4, {0.}, vp);
+	Trajectory traj;
+	solver.solve(traj);
+	ASSERT_EQ(traj.size(), 5);
+	EXPECT_DOUBLE_EQ(traj.time.back(), 2.);
+	EXPECT_DOUBLE_EQ(traj.states.back()[0], 2.);
+	EXPECT_EQ(solver.solve().size(), 5);
+}
+
+TEST(solver, hermite_dense_output)
+{
+	// cubics are reproduced exactly
+	auto cube = [](double t) { return t * t * t - t; };
+	auto slope = [](double t) { return 3 * t * t - 1; };
+	for (auto t : {0.5, 1.2, 1.9})
+		EXPECT_NEAR(hermite(0.5, cube(0.5), slope(0.5), 2, cube(2), slope(2), t),
+		            cube(t), 1e-12);
+
+	// between Euler states of x' = x the interpolant is convex like e^t,
+	// below the chord
+	VectorProcessor vp;
+	vp[1] = "x1";
+	auto states = EulerSolver(0.5, 2, {1.}, vp).solve();
+	auto d0 = (states[1][0] - states[0][0]) / 0.5;
+	auto d1 = (states[2][0] - states[1][0]) / 0.5;
+	auto dense = hermite(0, states[0][0], d0, 0.5, states[1][0], d1, 0.25);
+	auto chord = (states[0][0] + states[1][0]) / 2;
+	EXPECT_DOUBLE_EQ(hermite(0, states[0][0], d0, 0.5, states[1][0], d1, 0.5),
+	                 states[1][0]);
+	EXPECT_LT(dense, chord);
+}
+
+TEST(solver, copied_aux_variables)
+{
+	VectorProcessor vp;
+	vp[1] = "v";
+	vp["v"] = "x1";
+	auto copy = vp;
+	EXPECT_DOUBLE_EQ(copy({2})[0], 2);
+	EXPECT_DOUBLE_EQ(copy({3})[0], 3);
+}
+
+TEST(section, poincare)
+{
+	// harmonic oscillator crosses x2 = 0 upwards once per period
+	VectorProcessor vp;
+	vp[1] = "x2";
+	vp[2] = "-x1";
+	FormulaProcessor surface("x2", &vp);
+	auto step = 1e-4;
+	auto steps = int(3 * 2 * std::numbers::pi / step);
+	EulerSolver solver(step, steps, {1., 0.}, vp);
+
+	Trajectory hits;
+	solver.solve(PoincareSection(
+	  [&](const std::vector<double> &x) { return vp(surface, x); }, hits));
+	ASSERT_EQ(hits.size(), 3);
+	for (auto &x : hits.states) {
+		EXPECT_NEAR(x[0], -1, 1e-2);
+		EXPECT_NEAR(x[1], 0, 1e-12);
+	}
+	EXPECT_NEAR(hits.time[0], std::numbers::pi, 1e-2);
+}
+
+TEST(section, stroboscopic)
+{
+	VectorProcessor vp;
+	vp[1] = "1";
+	EulerSolver solver(0.3, 10, {0.}, vp);
+
+	Trajectory samples;
+	solver.solve(StroboscopicSection(1., samples));
+	ASSERT_EQ(samples.size(), 4);
+	for (auto k = 0u; k < samples.size(); k++) {
+		EXPECT_NEAR(samples.time[k], k, 1e-12);
+		EXPECT_NEAR(samples.states[k][0], k, 1e-12);
+	}
+	EXPECT_THROW(StroboscopicSection(0., samples), std::invalid_argument);
+}
+
+TEST(bifurcation, fixed_points)
+{
+	// x1 relaxes to k for every k
+	VectorProcessor vp;
+	vp[1] = "k - x1";
+	vp["k"] = "0";
+	BifurcationParams params{.parameter = "k",
+	                         .from = 1,
+	                         .to = 2,
+	                         .count = 11,
+	                         .step = 0.01,
+	                         .transient_steps = 2000,
+	                         .steps = 100,
+	                         .max_points = 5};
+	for (auto threads : {1u, 4u}) {
+		params.threads = threads;
+		auto points = bifurcation_diagram(vp, {0.}, params);
+		ASSERT_EQ(points.size(), 11 * 5);
+		for (auto &p : points)
+			EXPECT_NEAR(p.value, p.parameter, 1e-6);
+		EXPECT_DOUBLE_EQ(points.front().parameter, 1);
+		EXPECT_DOUBLE_EQ(points.back().parameter, 2);
+	}
+
+	// declared parameter is set in place, the result is the same
+	VectorProcessor with_parameter;
+	with_parameter.declare_parameter("k");
+	with_parameter[1] = "k - x1";
+	auto points = bifurcation_diagram(with_parameter, {0.}, params);
+	ASSERT_EQ(points.size(), 11 * 5);
+	for (auto &p : points)
+		EXPECT_NEAR(p.value, p.parameter, 1e-6);
+
+	// small values of aux variable aren't printed in scientific notation
+	params.from = 0;
+	params.to = 1e-4;
+	points = bifurcation_diagram(vp, {0.}, params);
+	ASSERT_EQ(points.size(), 11 * 5);
+	for (auto &p : points)
+		EXPECT_NEAR(p.value, p.parameter, 1e-10);
+
+	params.parameter = "q";
+	EXPECT_THROW(bifurcation_diagram(vp, {0.}, params), std::invalid_argument);
+}
+
+TEST(bifurcation, maxima)
+{
+	// stable limit cycle is a circle of radius k
+	VectorProcessor vp;
+	vp[1] = "x2 + x1 * r";
+	vp[2] = "x2 * r - x1";
+	vp["r"] = "k^2 - x1^2 - x2^2";
+	vp["k"] = "1";
+	BifurcationParams params{.parameter = "k",
+	                         .from = 1,
+	                         .to = 3,
+	                         .count = 3,
+	                         .step = 1e-3,
+	                         .transient_steps = 10000,
+	                         .steps = 20000,
+	                         .component = 0,
+	                         .collect = BifurcationCollect::Maxima};
+	auto points = bifurcation_diagram(vp, {0.5, 0.}, params);
+	EXPECT_FALSE(points.empty());
+	for (auto &p : points)
+		EXPECT_NEAR(p.value, p.parameter, 1e-2);
+}
+
+TEST(sde, philox)
+{
+	// known answer of the reference implementation
+	auto block = Philox(0)({0, 0, 0, 0});
+	EXPECT_EQ(block, (Philox::Block{0x6627e8d5, 0xe169c58d, 0xbc57ac4c,
+	                                0x9b00dbd8}));
+
+	std::vector<double> a(5), b(5);
+	Philox(7).normals(3, 1, a);
+	Philox(7).normals(3, 1, b);
+	EXPECT_EQ(a, b);
+	Philox(7).normals(3, 2, b);
+	EXPECT_NE(a, b);
+}
+
+TEST(sde, ornstein_uhlenbeck)
+{
+	// dx = -x dt + dW: mean is e^-t, variance (1 - e^-2t) / 2
+	VectorProcessor vp;
+	vp.declare_parameter("sigma", 1);
+	vp[1] = "-x1";
+	SdeParams params{
+	  .step = 1e-2, .steps = 200, .paths = 4000, .samples = 5, .seed = 1};
+	auto stats = sde_ensemble(vp, {"sigma"}, {1.}, params);
+	ASSERT_EQ(stats.time.size(), 5);
+	EXPECT_DOUBLE_EQ(stats.time.back(), 2);
+	for (auto s = 0; s < 5; s++) {
+		auto t = stats.time[s];
+		auto &moments = stats.moments[s][0];
+		auto sd = std::sqrt((1 - std::exp(-2 * t)) / 2);
+		EXPECT_EQ(moments.count, 4000);
+		EXPECT_NEAR(moments.mean, std::exp(-t), 0.05);
+		EXPECT_NEAR(std::sqrt(moments.variance()), sd, 0.05);
+		EXPECT_NEAR(stats.distribution[s][0].quantile(0.975),
+		            std::exp(-t) + 1.96 * sd, 0.1);
+	}
+
+	// paths don't depend on the worker integrating them
+	params.threads = 1;
+	auto single = sde_ensemble(vp, {"sigma"}, {1.}, params);
+	params.threads = 3;
+	auto several = sde_ensemble(vp, {"sigma"}, {1.}, params);
+	for (auto s = 0; s < 5; s++) {
+		EXPECT_EQ(single.moments[s][0].mean, several.moments[s][0].mean);
+		EXPECT_EQ(single.moments[s][0].m2, several.moments[s][0].m2);
+		EXPECT_EQ(single.distribution[s][0].quantile(0.1),
+		          several.distribution[s][0].quantile(0.1));
+	}
+
+	// geometric Brownian motion dx = x dW keeps mean 1 with Milstein too
+	VectorProcessor gbm;
+	gbm[1] = "0";
+	params.scheme = SdeScheme::Milstein;
+	auto milstein = sde_ensemble(gbm, {"0.5 * x1"}, {1.}, params);
+	EXPECT_NEAR(milstein.moments.back()[0].mean, 1, 0.05);
+	EXPECT_NEAR(milstein.distribution.back()[0].quantile(0.5),
+	            std::exp(-0.25), 0.05);
+
+	EXPECT_THROW(sde_ensemble(vp, {}, {1.}, params), std::invalid_argument);
+}
+
+TEST(storage, xor_codec_is_lossless)
+{
+	std::mt19937_64 gen(1);
+	std::uniform_real_distribution<double> noise(-1e3, 1e3);
+	XorColumn column;
+	std::vector<double> values;
+	for (auto i = 0; i < 5000; i++) {
+		values.push_back((i % 7) ? std::sin(i * 1e-3) : noise(gen));
+		column.append(values.back());
+	}
+	values.push_back(0.);
+	column.append(0.);
+
+	std::vector<double> decoded(values.size());
+	column.read(0, values.size(), decoded.data());
+	EXPECT_EQ(values, decoded);
+	column.read(1500, 10, decoded.data());
+	EXPECT_TRUE(std::equal(decoded.begin(), decoded.begin() + 10,
+	                       values.begin() + 1500));
+}
+
+TEST(storage, compressed_trajectory)
+{
+	VectorProcessor vp;
+	vp[1] = "x2";
+	vp[2] = "0 - x1";
+	EulerSolver solver(1e-3, 100000, {1., 0.}, vp);
+	Trajectory full;
+	CompressedStorage compressed;
+	ColumnStorage<float> floats;
+	solver.solve([&](double t, const std::vector<double> &x) {
+		full(t, x);
+		compressed(t, x);
+		floats(t, x);
+	});
+
+	ASSERT_EQ(compressed.size(), full.size());
+	EXPECT_EQ(compressed.dimension(), 2);
+	std::vector<double> column(full.size());
+	compressed.read(-1, 0, full.size(), column.data());
+	EXPECT_EQ(column, full.time);
+	compressed.read(1, 0, full.size(), column.data());
+	for (auto k = 0u; k < full.size(); k++) {
+		ASSERT_EQ(column[k], full.states[k][1]);
+		ASSERT_FLOAT_EQ(floats.value(1, k), full.states[k][1]);
+	}
+	auto k = 100u;
+	compressed.for_each_point(0, 1, k, [&](double x, double y) {
+		ASSERT_EQ(x, full.states[k][0]);
+		ASSERT_EQ(y, full.states[k++][1]);
+	});
+	EXPECT_EQ(k, full.size());
+	EXPECT_THROW(compressed.value(0, full.size()), std::out_of_range);
+	EXPECT_THROW(floats.value(0, full.size()), std::out_of_range);
+
+	auto raw_memory = full.size() * 3 * sizeof(double);
+	EXPECT_LT(compressed.memory(), raw_memory);
+	EXPECT_LT(floats.memory(), raw_memory);
+}
+
+TEST(storage, memory_estimate)
+{
+	auto n = 100001uz;
+	for (auto mode :
+	     {StorageMode::Double, StorageMode::Float, StorageMode::Compressed}) {
+		auto storage = make_storage(mode);
+		for (auto k = 0uz; k < n; k++)
+			(*storage)(k * 1e-3, {std::sin(k * 1e-3), std::cos(k * 1e-3)});
+		EXPECT_LE(storage->memory(), storage_estimate(mode, 2, n));
+		LodPyramid pyramid(*storage, 0, 1);
+		EXPECT_LE(pyramid.memory(), LodPyramid::memory_estimate(n));
+	}
+
+	// values which don't compress at all fit as well
+	std::mt19937_64 gen(1);
+	CompressedStorage noise;
+	for (auto k = 0uz; k < n; k++)
+		noise(std::bit_cast<double>(gen() >> 2), {std::bit_cast<double>(gen())});
+	EXPECT_LE(noise.memory(), storage_estimate(StorageMode::Compressed, 1, n));
+
+	// decimated output is what fits
+	Trajectory kept;
+	Decimation decimated(4, kept);
+	auto rp = [](const std::vector<double> &) { return std::vector{1.}; };
+	EulerSolver(1e-3, 10, {0.}, rp).solve(decimated);
+	ASSERT_EQ(kept.size(), 3);
+	EXPECT_DOUBLE_EQ(kept.time[2], 8e-3);
+}
+
+TEST(storage, lod_pyramid)
+{
+	ColumnStorage<double> storage;
+	auto n = 100000;
+	for (auto k = 0; k < n; k++)
+		storage(k, {std::sin(k * 1e-3)});
+	LodPyramid pyramid(storage, -1, 0);
+	EXPECT_EQ(pyramid.bounds().x_min, 0);
+	EXPECT_EQ(pyramid.bounds().x_max, n - 1);
+
+	// ranges come in order and cover the whole trajectory
+	auto next = 0uz;
+	auto visited = 0;
+	auto check = [&](size_t first, size_t last) {
+		EXPECT_EQ(first, next);
+		next = last;
+		visited++;
+	};
+	LodBox view;
+	view.add(1000, -1);
+	view.add(1100, 1);
+	pyramid.query(
+	  view, 1000, 1, [&](size_t f, size_t l) { check(f, l); },
+	  [&](size_t f, size_t l, const LodBox &) { check(f, l); },
+	  [&](size_t f, size_t l) {
+		  check(f, l);
+		  EXPECT_TRUE(l < 1000 || f > 1100);
+	  });
+	EXPECT_EQ(next, n - 1);
+	// only visible part is walked down to the leaves
+	EXPECT_LT(visited, 100);
+}
+
+TEST(storage, lod_pyramid_extend)
+{
+	// pyramid grown by random portions matches the one built at once
+	ColumnStorage<double> storage;
+	LodPyramid grown;
+	std::mt19937 gen(3);
+	std::uniform_int_distribution portion(0, 300);
+	auto k = 0;
+	while (k < 20000) {
+		for (auto n = portion(gen); n; n--, k++)
+			storage(k, {std::sin(k * 1e-2) * k});
+		grown.extend(storage, -1, 0);
+	}
+	LodPyramid whole(storage, -1, 0);
+	EXPECT_EQ(grown.size(), whole.size());
+	EXPECT_EQ(grown.bounds().y_min, whole.bounds().y_min);
+	EXPECT_EQ(grown.bounds().y_max, whole.bounds().y_max);
+
+	auto ranges = [](const LodPyramid &p) {
+		std::vector<size_t> result;
+		LodBox view;
+		view.add(5000, -1e3);
+		view.add(6000, 1e3);
+		auto add = [&](size_t f, size_t l) {
+			result.push_back(f);
+			result.push_back(l);
+		};
+		p.query(view, 10, 10, add, [&](size_t f, size_t l, auto &) { add(f, l); },
+		        add);
+		return result;
+	};
+	EXPECT_EQ(ranges(grown), ranges(whole));
+}
+
+TEST(storage, trajectory_files)
+{
+	VectorProcessor vp;
+	vp[1] = "x2";
+	vp[2] = "x1 * 0 - x1";
+	EulerSolver solver(1e-3, 1000, {1., 0.}, vp);
+	auto dir = std::filesystem::temp_directory_path();
+	auto bin = (dir / "drawcpp_test.bin").string();
+	auto csv = (dir / "drawcpp_test.csv").string();
+
+	Trajectory traj;
+	{
+		BinaryWriter binary(bin, 64); // several blocks, the last one is short
+		CsvWriter text(csv);
+		TeeSink files(binary, text);
+		TeeSink all(traj, files);
+		solver.solve(all);
+		binary.close();
+		text.close();
+	}
+
+	ColumnStorage<double> loaded;
+	load_trajectory(bin, loaded);
+	ASSERT_EQ(loaded.size(), traj.size());
+	for (auto k = 0uz; k < traj.size(); k++) {
+		EXPECT_EQ(loaded.value(-1, k), traj.time[k]);
+		EXPECT_EQ(loaded.value(1, k), traj.states[k][1]);
+	}
+
+	std::ifstream text(csv);
+	std::string line;
+	std::getline(text, line);
+	EXPECT_EQ(line, "t,x1,x2");
+	for (auto k = 0; k < 500; k++)
+		std::getline(text, line);
+	auto comma = line.find(',');
+	EXPECT_EQ(std::stod(line.substr(0, comma)), traj.time[499]);
+	EXPECT_EQ(std::stod(line.substr(comma + 1)), traj.states[499][0]);
+	std::filesystem::remove(bin);
+	std::filesystem::remove(csv);
+}
+
+TEST(storage, lookup_table)
+{
+	auto dir = std::filesystem::temp_directory_path();
+	auto bin = (dir / "drawcpp_table.bin").string();
+	auto csv = (dir / "drawcpp_table.csv").string();
+	{
+		BinaryWriter binary(bin, 64);
+		for (auto i = 0; i <= 1000; i++)
+			binary(i * 1e-2, {std::sin(i * 1e-2)});
+		binary.close();
+		std::ofstream text(csv);
+		text << "t,value\n0,0\n1,2\n1.5,1\n4,6\n";
+	}
+
+	LookupTable uniform(bin), irregular(csv);
+	ASSERT_EQ(uniform.size(), 1001);
+	size_t cursor = 0;
+	EXPECT_EQ(irregular(-1, cursor, false), 0);
+	EXPECT_EQ(irregular(9, cursor, false), 6);
+	EXPECT_DOUBLE_EQ(irregular(0.5, cursor, false), 1);
+	EXPECT_DOUBLE_EQ(irregular(1.25, cursor, false), 1.5);
+	EXPECT_DOUBLE_EQ(irregular(3, cursor, false), 4);
+	EXPECT_DOUBLE_EQ(irregular(1, cursor, true), 2);
+	for (auto t = 0.005; t < 10; t += 0.1) {
+		EXPECT_NEAR(uniform(t, cursor, false), std::sin(t), 2e-5);
+		EXPECT_NEAR(uniform(t, cursor, true), std::sin(t), 1e-6);
+	}
+
+	// x' = sin t given by samples integrates to 1 - cos t
+	VectorProcessor vp;
+	vp[1] = std::format("table(\"{}\", t)", bin);
+	auto states = EulerSolver(1e-3, 2000, {0.}, vp).solve();
+	EXPECT_NEAR(states.back()[0], 1 - std::cos(2.), 2e-3);
+	vp[1] = std::format("2 * table(\"{}\", t, cubic)", csv);
+	EXPECT_DOUBLE_EQ(vp(3, {0.})[0], 2 * irregular(3, cursor, true));
+	EXPECT_THROW(vp[1] = std::format("table(\"{}\")", csv),
+	             std::invalid_argument);
+	EXPECT_THROW(vp[1] = "table(\"missing.csv\", t)", std::runtime_error);
+	std::filesystem::remove(bin);
+	std::filesystem::remove(csv);
+}
+
+TEST(storage, density)
+{
+	ColumnStorage<double> storage;
+	auto n = 300000;
+	for (auto k = 0; k < n; k++)
+		storage(k, {std::sin(k * 1e-4), std::cos(k * 3e-4)});
+	LodPyramid pyramid(storage, 0, 1);
+
+	// per-thread histograms sum up to the single threaded one
+	Histogram single(-1, 1, -1, 1, 64, 48), parallel = single;
+	std::vector<std::pair<size_t, size_t>> all{{0, n / 3}, {n / 3, n}};
+	bin_ranges(single, storage, 0, 1, all, 1);
+	bin_ranges(parallel, storage, 0, 1, all, 4);
+	EXPECT_EQ(single.total(), n);
+	for (auto j = 0; j < single.height(); j++)
+		for (auto i = 0; i < single.width(); i++)
+			ASSERT_EQ(single(i, j), parallel(i, j));
+
+	// pyramid keeps every point, coarse nodes fall into neighbouring bins
+	Histogram coarse(-1.1, 1.1, -1.1, 1.1, 32, 32);
+	bin_all(coarse, storage, pyramid, 0, 1);
+	EXPECT_EQ(coarse.total(), n);
+	EXPECT_DOUBLE_EQ(tone(coarse.max(), coarse.max()), 1);
+	EXPECT_DOUBLE_EQ(tone(0, coarse.max()), 0);
+}
+
+int main(int argc, char *argv[])
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -123,6 +123,71 @@ TEST(test, full)
 	EXPECT_THROW(vec = vp({0, 0}), std::runtime_error);
 }
 
+TEST(test, parameters)
+{
+	VectorProcessor vp;
+	vp[1] = "k * x1 + v";
+	vp["v"] = "k ^ 2";
+	// formulas parsed before the declaration use the slot too
+	auto k = vp.declare_parameter("k", 2);
+	EXPECT_DOUBLE_EQ(vp({3})[0], 10);
+	vp.set_parameter(k, 3);
+	EXPECT_DOUBLE_EQ(vp({3})[0], 18);
+
+	auto copy = vp;
+	copy.set_parameter("k", 1);
+	EXPECT_DOUBLE_EQ(copy({3})[0], 4);
+	EXPECT_DOUBLE_EQ(vp.parameter("k"), 3);
+
+	EXPECT_THROW(vp["k"] = "1", std::invalid_argument);
+	EXPECT_THROW(vp.declare_parameter("v"), std::invalid_argument);
+	EXPECT_THROW(vp.declare_parameter("x1"), std::invalid_argument);
+	EXPECT_THROW(vp.set_parameter("q", 1), std::invalid_argument);
+}
+
+TEST(test, validation)
+{
+	VectorProcessor vp;
+	vp[1] = "x2";
+	vp[2] = "-x1";
+	vp[3] = "x5";
+	EXPECT_THROW(vp.finalize(), std::invalid_argument);
+	vp[3] = "y";
+	EXPECT_THROW(vp.finalize(), std::invalid_argument);
+	vp["y"] = "x1 ^ x2 ^ x3"; // needs brackets
+	EXPECT_THROW(vp.finalize(), std::invalid_argument);
+	vp["y"] = "(x1 ^ x2) ^ x3";
+	vp.finalize();
+	EXPECT_THROW(vp({1, 2}), std::invalid_argument);
+	EXPECT_DOUBLE_EQ(vp({1, 2, 3})[2], 1);
+
+	// formulas held by reference are checked again after assignment
+	auto &third = vp[3];
+	vp.finalize();
+	third = "x7";
+	EXPECT_THROW(vp({1, 2, 3}), std::invalid_argument);
+	third = "y";
+
+	EXPECT_THROW(FormulaProcessor("x1 * "), std::invalid_argument);
+	EXPECT_THROW(FormulaProcessor("x3")({1, 2}), std::invalid_argument);
+	FormulaProcessor f("a");
+	f = "x1 + x2";
+	EXPECT_DOUBLE_EQ(f({1, 2}), 3);
+	FormulaProcessor standalone;
+	standalone = "x1 * 2";
+	EXPECT_DOUBLE_EQ(standalone({4}), 8);
+
+	// trivial formula replaced by operations isn't followed for cycles
+	VectorProcessor chain;
+	chain["a"] = "b";
+	chain["b"] = "x1";
+	chain[1] = "a";
+	chain.finalize();
+	chain["a"] = "x1 + 1";
+	chain["b"] = "a * 2";
+	EXPECT_DOUBLE_EQ(chain({1})[0], 2);
+}
+
 int main(int argc, char *argv[])
 {
 	/*